@@ -0,0 +1,48 @@
+#define _DEFAULT_SOURCE
+#include "arena.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+int
+arena_init(struct arena_t *arena, size_t size, int count)
+{
+    arena->stride = (size + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1);
+    size_t length = arena->stride * (count > 0 ? count : 1);
+    size_t align = (length >= HUGE_PAGE_SIZE) ? HUGE_PAGE_SIZE : 0;
+
+    // Over-map so the data can be moved to a huge page boundary
+    arena->length = length + align;
+    arena->base = mmap(NULL, arena->length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena->base == MAP_FAILED)
+        return -1;
+
+    arena->data = arena->base;
+    if (align != 0)
+    {
+        uintptr_t address = (uintptr_t) arena->base;
+        arena->data = (char *) ((address + align - 1) & ~(uintptr_t) (align - 1));
+#ifdef MADV_HUGEPAGE
+        madvise(arena->data, length, MADV_HUGEPAGE);
+#endif
+    }
+    return 0;
+}
+
+void *
+arena_slot(struct arena_t *arena, int index)
+{
+    return arena->data + arena->stride * index;
+}
+
+void
+arena_destroy(struct arena_t *arena)
+{
+    munmap(arena->base, arena->length);
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define HUGE_PAGE_SIZE (2 << 20)
+
+// Zeroed fixed-size slots, each starting on its own cache line. Arenas of
+// a huge page or more are huge-page aligned and advised as such.
+struct arena_t
+{
+    void *base;
+    size_t length;
+    char *data;
+    size_t stride;
+};
+
+// -1 with errno set if the memory couldn't be mapped
+int
+arena_init(struct arena_t *, size_t size, int count);
+
+void *
+arena_slot(struct arena_t *, int index);
+
+void
+arena_destroy(struct arena_t *);
+
+#endif // ARENA_H
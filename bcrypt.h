@@ -0,0 +1,44 @@
+#ifndef BCRYPT_H
+#define BCRYPT_H
+
+#include "common.h"
+#include "singlethreaded.h"
+
+#include <stdbool.h>
+
+// Candidates hashed side by side in one batch by each engine
+#define BCRYPT_LANES_SCALAR 4
+#define BCRYPT_LANES_AVX2 8
+
+enum bcrypt_engine_t
+{
+    BCRYPT_CRYPT,
+    BCRYPT_LANES,
+    BCRYPT_AVX2,
+};
+
+extern enum bcrypt_engine_t bcrypt_engine;
+
+// Picked from the host's CPU features unless selected by name. false
+// for unknown names, avx2 falls back to lanes without AVX2
+bool
+bcrypt_select(const char *name);
+
+const char *
+bcrypt_engine_name(void);
+
+// $2a$, $2b$ and $2y$ hashes, unless the engine is crypt_r
+bool
+bcrypt_hash(const char *hash);
+
+// Buffers the candidate and hashes the batch once all lanes are filled,
+// so a match may report any of the buffered passwords
+bool
+bcrypt_handler(struct st_context_t *, struct task_t *);
+
+// Checks what is still buffered at the end of a leaf task by calling
+// handler once more, so wrapping handlers see the result
+bool
+bcrypt_flush(bool found, void *context, password_handler_t, struct task_t *);
+
+#endif // BCRYPT_H
@@ -0,0 +1,96 @@
+#ifndef BRUTE_H
+#define BRUTE_H
+
+// Embeddable interface of libbrute. Sessions are independent of each
+// other and of the brute executable, all calls are thread-safe, and the
+// library never prints or exits: errors come back as brute_status_t.
+
+#include <stdbool.h>
+
+#define BRUTE_PASSWORD_SIZE 20
+
+// The shared library is built with hidden visibility, only these escape
+#if defined(__GNUC__)
+#define BRUTE_API __attribute__((visibility("default")))
+#else
+#define BRUTE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum brute_status_t
+{
+    BRUTE_OK = 0,
+    BRUTE_EINVAL = -1,
+    BRUTE_ENOMEM = -2,
+    BRUTE_ETHREAD = -3,
+    BRUTE_ENOJOB = -4,
+};
+
+enum brute_job_mode_t
+{
+    BRUTE_ITERATIVE,
+    BRUTE_RECURSIVE,
+    BRUTE_REC_ITERATOR,
+};
+
+enum brute_result_t
+{
+    BRUTE_RUNNING,
+    BRUTE_FOUND,
+    BRUTE_NOT_FOUND,
+    BRUTE_CANCELLED,
+};
+
+struct brute_job_t
+{
+    const char *hash;
+    const char *alphabet;
+    int length;
+    enum brute_job_mode_t mode;
+};
+
+struct brute_progress_t
+{
+    enum brute_result_t result;
+    long long tasks_done, tasks_total;
+};
+
+struct brute_session_t;
+
+// Called once per job, from a pool thread or from the call that cancelled
+// it. password is NULL unless found and only valid during the call
+typedef void (*brute_callback_t)(void *user, int job_id,
+                                 enum brute_result_t, const char *password);
+
+// threads == 0 starts one thread per online CPU, callback may be NULL
+BRUTE_API int
+brute_session_create(struct brute_session_t **, int threads,
+                     brute_callback_t callback, void *user);
+
+// Cancels the remaining jobs, waits for the pool and frees the session
+BRUTE_API void
+brute_session_destroy(struct brute_session_t *);
+
+BRUTE_API int
+brute_submit(struct brute_session_t *, const struct brute_job_t *, int *job_id);
+
+BRUTE_API int
+brute_poll(struct brute_session_t *, int job_id, struct brute_progress_t *);
+
+// Blocks until the job is over, password may be NULL or have room for
+// BRUTE_PASSWORD_SIZE bytes
+BRUTE_API int
+brute_wait(struct brute_session_t *, int job_id, enum brute_result_t *,
+           char *password);
+
+BRUTE_API int
+brute_cancel(struct brute_session_t *, int job_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BRUTE_H
@@ -4,11 +4,16 @@
 #include "common.h"
 #include "iterative.h"
 #include "recursive.h"
+#include "shm.h"
+#include "trace.h"
+#include "jobs.h"
+#include "arena.h"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -18,32 +23,136 @@
 #define handle_error(msg) \
     do { perror(msg); exit(EXIT_FAILURE); } while (0)
 
+// Hashes the task on this host
+static bool
+cl_local_runner(void *context, struct task_t *task, struct config_t *config)
+{
+    struct st_context_t *st_context = (struct st_context_t *) context;
+    st_context->hash = config->hash;
+    uint64_t start = trace_begin();
+    bool found = process_task(task, config, st_context, st_password_handler);
+    trace_end("task", H_TASK, start);
+    return found;
+}
+
+struct cl_watch_t
+{
+    int socket;
+    volatile bool *stop;
+};
+
+// The only command the server sends during a task is CMD_CANCEL, in one
+// piece so that cancelling the watcher never splits it
+static void *
+cl_watch(void *arg)
+{
+    struct cl_watch_t *watch = (struct cl_watch_t *) arg;
+    int header[2];
+    if (recvall(watch->socket, header, sizeof(header), 0) != -1
+        && header[0] == CMD_CANCEL)
+        *watch->stop = true;
+    return NULL;
+}
+
+// Runs the task while a thread watches the socket for its cancellation,
+// a cancelled task is reported as not found
+static bool
+cl_run(int network_socket, struct task_t *task, struct config_t *config,
+       client_runner_t runner, void *context, volatile bool *stop)
+{
+    if (stop == NULL)
+        return runner(context, task, config);
+    *stop = false;
+    pthread_t watcher;
+    struct cl_watch_t watch = { network_socket, stop };
+    if (pthread_create(&watcher, NULL, cl_watch, &watch) != 0)
+        return runner(context, task, config);
+
+    bool found = runner(context, task, config);
+    pthread_cancel(watcher);
+    pthread_join(watcher, NULL);
+    return found && !*stop;
+}
+
 static int
-cl_process_task(int network_socket, struct task_t *task,
-                struct st_context_t *context, struct config_t *config)
+cl_process_task(int network_socket, struct task_t *task, struct config_t *config,
+                client_runner_t runner, void *context, volatile bool *stop)
 {
     int status;
 
-    bool found = process_task(task, config, context, st_password_handler);
+    bool found = cl_run(network_socket, task, config, runner, context, stop);
     if (found)
     {
         int msg = (int) sizeof(task->password);
-        status = sendall(network_socket, &msg, sizeof(int), 0);
+        status = sendall(network_socket, &msg, sizeof(int), MSG_NOSIGNAL);
         if (status == -1) return -1;
-        status = sendall(network_socket, task->password, msg, 0);
+        status = sendall(network_socket, task->password, msg, MSG_NOSIGNAL);
         if (status == -1) return -1;
     }
     else
     {
         int msg = 0;
-        status = sendall(network_socket, &msg, sizeof(int), 0);
+        status = sendall(network_socket, &msg, sizeof(int), MSG_NOSIGNAL);
         if (status == -1) return -1;
     }
     return 0;
 }
 
+// Serves tasks from shared memory until the server talks over the socket,
+// false if the server asked to stop through the ring
+static bool
+cl_shm_loop(int network_socket, struct shm_channel_t *channel, struct task_t *task,
+            struct config_t *config, client_runner_t runner, void *context,
+            volatile bool *stop)
+{
+    struct shm_message_t message;
+    while (shm_pop(&channel->requests, &message, network_socket) == 0)
+    {
+        if (message.command != CMD_TASK)
+            return false;
+        *task = message.task;
+        message.found = cl_run(network_socket, task, config, runner, context, stop);
+        message.task = *task;
+        shm_push(&channel->responses, &message);
+    }
+    return true;
+}
+
+// Takes over the hash, alphabet, length and mode of the server's job
+static int
+cl_apply_job(int network_socket, int length, struct job_desc_t *job,
+             struct config_t *config)
+{
+    if (length != sizeof(struct job_desc_t))
+        return -1;
+    int status = recvall(network_socket, job, length, 0);
+    if (status == -1) return -1;
+
+    // Wordlists and models are never sent, they must be loaded locally
+    int reply = 0;
+    bool wordlist = (job->brute_mode == M_WORDLIST || job->brute_mode == M_HYBRID
+                     || job->brute_mode == M_HYBRID_PREFIX);
+    if ((wordlist && config->wordlist == NULL)
+        || (job->brute_mode == M_MARKOV && config->markov == NULL)
+        || job->length <= 0 || job->length >= PASSWORD_SIZE)
+    {
+        reply = -1;
+    }
+    else
+    {
+        job->hash[JOB_HASH_SIZE - 1] = '\0';
+        job->alphabet[JOB_ALPHABET_SIZE - 1] = '\0';
+        job_apply(job, config);
+    }
+
+    status = sendall(network_socket, &reply, sizeof(reply), 0);
+    if (status == -1 || reply != 0) return -1;
+    return 0;
+}
+
 bool
-run_client(struct task_t *task, struct config_t *config)
+client_serve(struct task_t *task, struct config_t *config,
+             client_runner_t runner, void *context, volatile bool *stop)
 {
     int network_socket = socket(AF_INET, SOCK_STREAM, 0);
 
@@ -63,10 +172,8 @@ run_client(struct task_t *task, struct config_t *config)
     }
     printf("Connected to server\n");
 
-    struct st_context_t st_context;
-    st_context.hash = config->hash;
-    st_context.cd.initialized = 0;
-
+    struct job_desc_t job;
+    struct shm_channel_t *channel = NULL;
     bool found = false;
     int status;
     while (!found)
@@ -88,16 +195,56 @@ run_client(struct task_t *task, struct config_t *config)
             status = recvall(network_socket, task, length, 0);
             if (status == -1) goto exit_label;
 
-            status = cl_process_task(network_socket, task, &st_context, config);
+            status = cl_process_task(network_socket, task, config, runner,
+                                     context, stop);
             if (status == -1) goto exit_label;
 
             break;
+        case CMD_JOB:
+            status = cl_apply_job(network_socket, length, &job, config);
+            if (status == -1) goto exit_label;
+            break;
+        case CMD_SHM:
+            channel = shm_accept(network_socket, length);
+            if (channel != NULL)
+                printf("Using shared memory transport\n");
+            break;
+        case CMD_CANCEL:
+            // Came in after the task it was meant for was done
+            break;
+        }
+
+        // Back to the ring after every command that came over the socket
+        if (channel != NULL
+            && !cl_shm_loop(network_socket, channel, task, config, runner,
+                            context, stop))
+        {
+            goto exit_label;
         }
     }
 
 exit_label:
 
+    if (channel != NULL)
+        shm_close(channel);
     close(network_socket);
 
     return found;
 }
+
+bool
+run_client(struct task_t *task, struct config_t *config)
+{
+    struct arena_t arena;
+    if (arena_init(&arena, sizeof(struct crypt_data), 1) == -1)
+        handle_error("mmap");
+    struct st_context_t st_context;
+    st_context.hash = config->hash;
+    st_context.cd = arena_slot(&arena, 0);
+    volatile bool stop = false;
+    st_context.stop = &stop;
+
+    bool found = client_serve(task, config, cl_local_runner, &st_context, &stop);
+    arena_destroy(&arena);
+    return found;
+}
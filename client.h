@@ -6,7 +6,18 @@
 struct task_t;
 struct config_t;
 
+// Runs one task of the coordinator's current job, which config describes,
+// true if the password was found
+typedef bool (*client_runner_t)(void *, struct task_t *, struct config_t *);
+
 bool
 run_client(struct task_t *, struct config_t *);
 
+// Takes tasks from the coordinator at config->address until it says to
+// stop, each one is handed to runner. The coordinator cancels a task by
+// setting stop, which the runner must watch, NULL if it can't.
+bool
+client_serve(struct task_t *, struct config_t *, client_runner_t, void *,
+             volatile bool *stop);
+
 #endif // CLIENT_H
@@ -1,9 +1,46 @@
-#include "common.h"
 #define _GNU_SOURCE
+#include "common.h"
 #include <unistd.h>
 #include <errno.h>
 #include <sys/socket.h>
 
+// Tasks are dealt round-robin, so each shard gets every shard_count-th one.
+// Wordlist and Markov tasks differ a lot in size, those modes get a
+// balanced slice of the keyspace up front (wl_shard, markov_shard).
+bool
+shard_owns(struct config_t *config, long long seq)
+{
+    switch (config->brute_mode)
+    {
+    case M_WORDLIST:
+    case M_HYBRID:
+    case M_HYBRID_PREFIX:
+    case M_MARKOV:
+        return true;
+    default:
+        return seq % config->shard_count == config->shard_index;
+    }
+}
+
+int
+thread_count(struct config_t *config)
+{
+    if (config->threads > 0)
+        return config->threads;
+    return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// Tasks fix all but the first split positions, never more than the whole
+// password so a single task can cover the keyspace
+int
+split_point(struct config_t *config)
+{
+    int split = config->split;
+    if (split <= 0)
+        split = (config->length < 3) ? 1 : 2;
+    return (split < config->length) ? split : config->length;
+}
+
 int
 sendall(const int socket_fd, const void *data, const int size, const int flags)
 {
@@ -27,7 +64,7 @@ recvall(const int socket_fd, void *data, const int size, const int flags)
     while (bytes_to_read > 0)
     {
         int nread = TEMP_FAILURE_RETRY(recv(socket_fd, bytes, bytes_to_read, flags));
-        if (nread == -1) return -1;
+        if (nread == -1 || nread == 0) return -1;
         bytes_to_read -= nread;
         bytes += nread;
     }
@@ -2,6 +2,11 @@
 #define COMMON_H
 
 #include <stdbool.h>
+#include <sys/socket.h>
+
+// Fields written by different threads are kept on separate cache lines
+#define CACHE_LINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
 
 #define PASSWORD_SIZE 20
 typedef char password_t[PASSWORD_SIZE];
@@ -10,6 +15,9 @@ struct task_t
 {
     password_t password;
     int from, to;
+    // Newline-aligned byte range of the wordlist or range of Markov
+    // task ids, unused by other modes
+    long long offset, end;
 };
 
 enum brute_mode_t
@@ -17,6 +25,12 @@ enum brute_mode_t
     M_RECURSIVE,
     M_ITERATIVE,
     M_REC_ITERATOR,
+    M_WORDLIST,
+    M_MARKOV,
+    // Every word of the wordlist followed or preceded by all length
+    // characters long tails of the alphabet
+    M_HYBRID,
+    M_HYBRID_PREFIX,
 };
 
 enum run_mode_t
@@ -26,8 +40,18 @@ enum run_mode_t
     M_GENERATOR,
     M_SERVER,
     M_CLIENT,
+    M_BUILD_TABLE,
+    M_TABLE,
+    M_STDOUT,
+    M_SIMULATE,
+    // Client of an upstream coordinator and server of its own clients
+    M_RELAY,
 };
 
+struct wordlist_t;
+struct rules_t;
+struct markov_t;
+
 struct config_t
 {
     char *alphabet;
@@ -37,16 +61,60 @@ struct config_t
     char *hash;
     char *address;
     int port;
+    // Port a relay serves its own clients on
+    int relay_port;
+    char *wordlist_path;
+    struct wordlist_t *wordlist;
+    char *rules_path;
+    struct rules_t *rules;
+    char *markov_path;
+    char *markov_corpus;
+    struct markov_t *markov;
+    int markov_level;
+    int shard_index, shard_count;
+    char *table_path;
+    char *potfile_path;
+    int reserved_cores;
+    char *trace_path;
+    char *jobs_path;
+    char *sim_path;
+    // Leading positions enumerated by each task handed out, 0 for 2
+    int split;
+    // Worker threads, 0 for one per online CPU
+    int threads;
+    // MiB the workers of a memory-hard hash may use, 0 for half of the
+    // available memory
+    int mem_budget;
 };
 
 enum command_t
 {
     CMD_EXIT = 1,
     CMD_TASK,
+    CMD_SHM,
+    CMD_JOB,
+    // Stops the task in progress, another copy of it finished first. The
+    // client answers it like any other task, an idle one ignores it.
+    CMD_CANCEL,
 };
 
 typedef bool (*password_handler_t)(void *, struct task_t *);
 
+// Peers that went away are reported by sendall instead of killing us
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+bool
+shard_owns(struct config_t *, long long seq);
+
+int
+thread_count(struct config_t *);
+
+// Value of task->from that splits the keyspace into tasks
+int
+split_point(struct config_t *);
+
 int
 sendall(const int socket_fd, const void *data, const int size, const int flags);
 
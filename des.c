@@ -0,0 +1,328 @@
+#include "des.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Traditional crypt(3) is 25 DES encryptions of a zero block keyed by the
+// low 7 bits of the first 8 password characters, with 12 salt bits
+// swapping bits of the E expansion. Every key bit lands on fixed bits of
+// the 16 subkeys, so a schedule is the XOR of the schedules of its set
+// bits: consecutive candidates only redo the bits that differ.
+
+#define DES_ROUNDS 16
+#define DES_ITERATIONS 25
+#define DES_KEY_CHARS 8
+#define DES_CHAR_BITS 7
+#define DES_HASH_SIZE 13
+
+static const uint8_t des_ip[64] = {
+    58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4,
+    62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+    57, 49, 41, 33, 25, 17, 9, 1, 59, 51, 43, 35, 27, 19, 11, 3,
+    61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7,
+};
+
+static const uint8_t des_p[32] = {
+    16, 7, 20, 21, 29, 12, 28, 17, 1, 15, 23, 26, 5, 18, 31, 10,
+    2, 8, 24, 14, 32, 27, 3, 9, 19, 13, 30, 6, 22, 11, 4, 25,
+};
+
+static const uint8_t des_pc1[56] = {
+    57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18,
+    10, 2, 59, 51, 43, 35, 27, 19, 11, 3, 60, 52, 44, 36,
+    63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22,
+    14, 6, 61, 53, 45, 37, 29, 21, 13, 5, 28, 20, 12, 4,
+};
+
+static const uint8_t des_pc2[48] = {
+    14, 17, 11, 24, 1, 5, 3, 28, 15, 6, 21, 10,
+    23, 19, 12, 4, 26, 8, 16, 7, 27, 20, 13, 2,
+    41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+    44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32,
+};
+
+static const uint8_t des_shifts[DES_ROUNDS] = {
+    1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1,
+};
+
+static const uint8_t des_sbox[8][64] = {
+    {
+        14, 4, 13, 1, 2, 15, 11, 8, 3, 10, 6, 12, 5, 9, 0, 7,
+        0, 15, 7, 4, 14, 2, 13, 1, 10, 6, 12, 11, 9, 5, 3, 8,
+        4, 1, 14, 8, 13, 6, 2, 11, 15, 12, 9, 7, 3, 10, 5, 0,
+        15, 12, 8, 2, 4, 9, 1, 7, 5, 11, 3, 14, 10, 0, 6, 13,
+    },
+    {
+        15, 1, 8, 14, 6, 11, 3, 4, 9, 7, 2, 13, 12, 0, 5, 10,
+        3, 13, 4, 7, 15, 2, 8, 14, 12, 0, 1, 10, 6, 9, 11, 5,
+        0, 14, 7, 11, 10, 4, 13, 1, 5, 8, 12, 6, 9, 3, 2, 15,
+        13, 8, 10, 1, 3, 15, 4, 2, 11, 6, 7, 12, 0, 5, 14, 9,
+    },
+    {
+        10, 0, 9, 14, 6, 3, 15, 5, 1, 13, 12, 7, 11, 4, 2, 8,
+        13, 7, 0, 9, 3, 4, 6, 10, 2, 8, 5, 14, 12, 11, 15, 1,
+        13, 6, 4, 9, 8, 15, 3, 0, 11, 1, 2, 12, 5, 10, 14, 7,
+        1, 10, 13, 0, 6, 9, 8, 7, 4, 15, 14, 3, 11, 5, 2, 12,
+    },
+    {
+        7, 13, 14, 3, 0, 6, 9, 10, 1, 2, 8, 5, 11, 12, 4, 15,
+        13, 8, 11, 5, 6, 15, 0, 3, 4, 7, 2, 12, 1, 10, 14, 9,
+        10, 6, 9, 0, 12, 11, 7, 13, 15, 1, 3, 14, 5, 2, 8, 4,
+        3, 15, 0, 6, 10, 1, 13, 8, 9, 4, 5, 11, 12, 7, 2, 14,
+    },
+    {
+        2, 12, 4, 1, 7, 10, 11, 6, 8, 5, 3, 15, 13, 0, 14, 9,
+        14, 11, 2, 12, 4, 7, 13, 1, 5, 0, 15, 10, 3, 9, 8, 6,
+        4, 2, 1, 11, 10, 13, 7, 8, 15, 9, 12, 5, 6, 3, 0, 14,
+        11, 8, 12, 7, 1, 14, 2, 13, 6, 15, 0, 9, 10, 4, 5, 3,
+    },
+    {
+        12, 1, 10, 15, 9, 2, 6, 8, 0, 13, 3, 4, 14, 7, 5, 11,
+        10, 15, 4, 2, 7, 12, 9, 5, 6, 1, 13, 14, 0, 11, 3, 8,
+        9, 14, 15, 5, 2, 8, 12, 3, 7, 0, 4, 10, 1, 13, 11, 6,
+        4, 3, 2, 12, 9, 5, 15, 10, 11, 14, 1, 7, 6, 0, 8, 13,
+    },
+    {
+        4, 11, 2, 14, 15, 0, 8, 13, 3, 12, 9, 7, 5, 10, 6, 1,
+        13, 0, 11, 7, 4, 9, 1, 10, 14, 3, 5, 12, 2, 15, 8, 6,
+        1, 4, 11, 13, 12, 3, 7, 14, 10, 15, 6, 8, 0, 5, 9, 2,
+        6, 11, 13, 8, 1, 4, 10, 7, 9, 5, 0, 15, 14, 2, 3, 12,
+    },
+    {
+        13, 2, 8, 4, 6, 15, 11, 1, 10, 9, 3, 14, 5, 0, 12, 7,
+        1, 15, 13, 8, 10, 3, 7, 4, 12, 5, 6, 11, 0, 14, 9, 2,
+        7, 11, 4, 1, 9, 12, 14, 2, 0, 6, 10, 13, 15, 3, 5, 8,
+        2, 1, 14, 7, 4, 10, 8, 13, 15, 12, 9, 0, 3, 5, 6, 11,
+    },
+};
+
+static const char des_itoa64[] =
+    "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+// A subkey is two words matching the rotations of R in des_round: the
+// even S-box groups in the top 6 bits of each byte of the first, the odd
+// ones in the second
+typedef uint32_t des_subkey_t[2];
+
+// S-box and P permutation combined, indexed by the 6 raw input bits
+static uint32_t des_sp[8][64];
+// Schedule of each of the 7 bits of each key character on its own
+static des_subkey_t des_bit_ks[DES_KEY_CHARS][DES_CHAR_BITS][DES_ROUNDS];
+static pthread_once_t des_once = PTHREAD_ONCE_INIT;
+
+// Per thread, the schedule stays valid across hashes as it only
+// depends on the key
+struct des_state_t
+{
+    des_subkey_t ks[DES_ROUNDS];
+    unsigned char key[DES_KEY_CHARS];
+    char hash[DES_HASH_SIZE + 1];
+    bool valid;
+    // Swap masks for both subkey words, in the bytes of groups 4 and 5
+    uint32_t salt[2];
+    // Expected L and R, before the final permutation
+    uint32_t target[2];
+};
+
+enum des_engine_t des_engine = DES_INCREMENTAL;
+
+static __thread struct des_state_t local;
+
+bool
+des_select(const char *name)
+{
+    if (strcmp(name, "crypt") == 0)
+        des_engine = DES_CRYPT;
+    else if (strcmp(name, "incremental") == 0)
+        des_engine = DES_INCREMENTAL;
+    else
+        return false;
+    return true;
+}
+
+const char *
+des_engine_name(void)
+{
+    static const char *names[] = { "crypt_r", "des-incr" };
+    return names[des_engine];
+}
+
+// Bit n of a table counts from 1 at the most significant end
+static uint64_t
+des_permute(uint64_t in, int in_bits, const uint8_t *table, int out_bits)
+{
+    uint64_t out = 0;
+    for (int i = 0; i < out_bits; ++i)
+        out = (out << 1) | ((in >> (in_bits - table[i])) & 1);
+    return out;
+}
+
+static void
+des_schedule(uint64_t key, des_subkey_t *ks)
+{
+    uint64_t cd = des_permute(key, 64, des_pc1, 56);
+    uint32_t c = cd >> 28, d = cd & 0xfffffff;
+    for (int r = 0; r < DES_ROUNDS; ++r)
+    {
+        for (int i = 0; i < des_shifts[r]; ++i)
+        {
+            c = ((c << 1) | (c >> 27)) & 0xfffffff;
+            d = ((d << 1) | (d >> 27)) & 0xfffffff;
+        }
+        uint64_t k = des_permute(((uint64_t) c << 28) | d, 56, des_pc2, 48);
+        ks[r][0] = ks[r][1] = 0;
+        for (int j = 0; j < 8; ++j)
+        {
+            uint32_t group = (k >> (42 - 6 * j)) & 0x3f;
+            ks[r][j & 1] |= group << (2 + 8 * (3 - j / 2));
+        }
+    }
+}
+
+static void
+des_init(void)
+{
+    for (int j = 0; j < 8; ++j)
+    {
+        for (int x = 0; x < 64; ++x)
+        {
+            int row = ((x >> 4) & 2) | (x & 1), column = (x >> 1) & 0xf;
+            uint64_t s = (uint64_t) des_sbox[j][row * 16 + column] << (28 - 4 * j);
+            des_sp[j][x] = des_permute(s, 32, des_p, 32);
+        }
+    }
+
+    for (int p = 0; p < DES_KEY_CHARS; ++p)
+    {
+        // Characters are shifted left by one, bit 0 of each byte is parity
+        for (int b = 0; b < DES_CHAR_BITS; ++b)
+            des_schedule((uint64_t) (1 << b) << (1 + 8 * (7 - p)), des_bit_ks[p][b]);
+    }
+}
+
+static int
+des_atoi64(char c)
+{
+    const char *p = (c != '\0') ? strchr(des_itoa64, c) : NULL;
+    return (p != NULL) ? p - des_itoa64 : -1;
+}
+
+// Hashes whose 2 padding bits are set never come out of crypt, those are
+// left to crypt_r to reject
+static void
+des_parse(struct des_state_t *state, const char *hash)
+{
+    snprintf(state->hash, sizeof(state->hash), "%s", hash);
+    state->valid = false;
+    if (strlen(hash) != DES_HASH_SIZE)
+        return;
+    int digits[DES_HASH_SIZE];
+    for (int i = 0; i < DES_HASH_SIZE; ++i)
+    {
+        if ((digits[i] = des_atoi64(hash[i])) < 0)
+            return;
+    }
+    if (digits[DES_HASH_SIZE - 1] & 3)
+        return;
+
+    // Salt bit i swaps bit i and i + 24 of the E expansion, which are at
+    // the same bits of groups 0/4 and 1/5
+    int salt = digits[0] | (digits[1] << 6);
+    state->salt[0] = state->salt[1] = 0;
+    for (int i = 0; i < 12; ++i)
+    {
+        if (salt & (1 << i))
+            state->salt[i / 6] |= 1u << (10 + 5 - i % 6);
+    }
+
+    uint64_t out = 0;
+    for (int i = 2; i < DES_HASH_SIZE - 1; ++i)
+        out = (out << 6) | digits[i];
+    out = (out << 4) | (digits[DES_HASH_SIZE - 1] >> 2);
+    uint64_t lr = des_permute(out, 64, des_ip, 64);
+    state->target[0] = lr >> 32;
+    state->target[1] = lr & 0xffffffff;
+    state->valid = true;
+}
+
+bool
+des_hash(const char *hash)
+{
+    if (des_engine == DES_CRYPT || hash[0] == '$')
+        return false;
+    pthread_once(&des_once, des_init);
+    struct des_state_t *state = &local;
+    if (strncmp(state->hash, hash, sizeof(state->hash)) != 0)
+        des_parse(state, hash);
+    return state->valid;
+}
+
+static inline uint32_t
+des_rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+// Group j of E(R) is bits 27 - 4j to 32 - 4j of R, circularly. Rotating R
+// right by 1 puts the even groups in the top 6 bits of each byte and
+// rotating it left by 3 the odd ones, salted pairs end up 16 bits apart.
+static inline __attribute__((always_inline)) uint32_t
+des_f(uint32_t r, const uint32_t *k, uint32_t salt0, uint32_t salt1)
+{
+    uint32_t w0 = des_rotl(r, 31), w1 = des_rotl(r, 3);
+    uint32_t f0 = (w0 ^ (w0 >> 16)) & salt0;
+    uint32_t f1 = (w1 ^ (w1 >> 16)) & salt1;
+    w0 ^= f0 ^ (f0 << 16) ^ k[0];
+    w1 ^= f1 ^ (f1 << 16) ^ k[1];
+    return des_sp[0][w0 >> 26] ^ des_sp[2][(w0 >> 18) & 0x3f]
+           ^ des_sp[4][(w0 >> 10) & 0x3f] ^ des_sp[6][(w0 >> 2) & 0x3f]
+           ^ des_sp[1][w1 >> 26] ^ des_sp[3][(w1 >> 18) & 0x3f]
+           ^ des_sp[5][(w1 >> 10) & 0x3f] ^ des_sp[7][(w1 >> 2) & 0x3f];
+}
+
+static void
+des_set_key(struct des_state_t *state, const char *password)
+{
+    const char *c = password;
+    for (int p = 0; p < DES_KEY_CHARS; ++p)
+    {
+        unsigned char next = *c & 0x7f;
+        if (*c != '\0')
+            ++c;
+        unsigned diff = state->key[p] ^ next;
+        state->key[p] = next;
+        while (diff != 0)
+        {
+            const des_subkey_t *bit_ks = des_bit_ks[p][__builtin_ctz(diff)];
+            for (int r = 0; r < DES_ROUNDS; ++r)
+            {
+                state->ks[r][0] ^= bit_ks[r][0];
+                state->ks[r][1] ^= bit_ks[r][1];
+            }
+            diff &= diff - 1;
+        }
+    }
+}
+
+bool
+des_handler(struct st_context_t *ctx, struct task_t *task)
+{
+    struct des_state_t *state = &local;
+    des_set_key(state, task->password);
+
+    uint32_t l = 0, r = 0, salt0 = state->salt[0], salt1 = state->salt[1];
+    for (int i = 0; i < DES_ITERATIONS; ++i)
+    {
+        for (int k = 0; k < DES_ROUNDS; k += 2)
+        {
+            l ^= des_f(r, state->ks[k], salt0, salt1);
+            r ^= des_f(l, state->ks[k + 1], salt0, salt1);
+        }
+        uint32_t t = l;
+        l = r;
+        r = t;
+    }
+    return l == state->target[0] && r == state->target[1];
+}
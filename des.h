@@ -0,0 +1,33 @@
+#ifndef DES_H
+#define DES_H
+
+#include "common.h"
+#include "singlethreaded.h"
+
+#include <stdbool.h>
+
+enum des_engine_t
+{
+    DES_CRYPT,
+    DES_INCREMENTAL,
+};
+
+extern enum des_engine_t des_engine;
+
+// false for unknown names
+bool
+des_select(const char *name);
+
+const char *
+des_engine_name(void);
+
+// Traditional 13 character DES crypt hashes, unless the engine is crypt_r
+bool
+des_hash(const char *hash);
+
+// Keeps the key schedule of the previous candidate per thread and only
+// redoes the subkey bits of characters that changed since
+bool
+des_handler(struct st_context_t *, struct task_t *);
+
+#endif // DES_H
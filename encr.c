@@ -1,17 +1,180 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <crypt.h>
 
+// Input lines hashed between two writes of the output buffer
+#define BATCH_SIZE 4096
+#define HASH_SIZE 128
+
+#define handle_error(msg) \
+  do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+struct entry_t
+{
+  char *line;
+  size_t capacity;
+  char *password, *salt;
+  char hash[HASH_SIZE];
+};
+
+// Workers hash one batch per generation, the main thread reads and writes
+struct batch_t
+{
+  struct entry_t entries[BATCH_SIZE];
+  int count, next, finished, workers;
+  unsigned generation;
+  bool quit;
+  pthread_mutex_t mutex;
+  pthread_cond_t work, done;
+};
+
+static void *
+batch_worker(void *arg)
+{
+  struct batch_t *batch = (struct batch_t *) arg;
+  struct crypt_data *cd = calloc(1, sizeof(struct crypt_data));
+  if (cd == NULL)
+    handle_error("Couldn't allocate space for crypt_data");
+
+  unsigned seen = 0;
+  while (true)
+  {
+    pthread_mutex_lock(&batch->mutex);
+    while (batch->generation == seen && !batch->quit)
+      pthread_cond_wait(&batch->work, &batch->mutex);
+    seen = batch->generation;
+    bool quit = batch->quit;
+    pthread_mutex_unlock(&batch->mutex);
+    if (quit)
+      break;
+
+    int i;
+    while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count)
+    {
+      struct entry_t *entry = &batch->entries[i];
+      char *hash = crypt_r(entry->password, entry->salt, cd);
+      if (hash == NULL)
+        hash = "*0";
+      snprintf(entry->hash, sizeof(entry->hash), "%s", hash);
+    }
+
+    pthread_mutex_lock(&batch->mutex);
+    if (++batch->finished == batch->workers)
+      pthread_cond_signal(&batch->done);
+    pthread_mutex_unlock(&batch->mutex);
+  }
+
+  free(cd);
+  return NULL;
+}
+
+// Lines are "password" or "password<TAB>salt"
+static int
+batch_read(struct batch_t *batch, FILE *in, char *salt)
+{
+  int count = 0;
+  for (; count < BATCH_SIZE; ++count)
+  {
+    struct entry_t *entry = &batch->entries[count];
+    ssize_t length = getline(&entry->line, &entry->capacity, in);
+    if (length == -1)
+      break;
+    while (length > 0 && (entry->line[length - 1] == '\n'
+                          || entry->line[length - 1] == '\r'))
+      entry->line[--length] = '\0';
+
+    entry->password = entry->line;
+    entry->salt = salt;
+    char *tab = strchr(entry->line, '\t');
+    if (tab != NULL)
+    {
+      *tab = '\0';
+      entry->salt = tab + 1;
+    }
+  }
+  return count;
+}
+
+static void
+batch_run(FILE *in, char *salt, int threads, bool tagged)
+{
+  struct batch_t *batch = calloc(1, sizeof(struct batch_t));
+  if (batch == NULL)
+    handle_error("Couldn't allocate space for batch_t");
+  pthread_mutex_init(&batch->mutex, NULL);
+  pthread_cond_init(&batch->work, NULL);
+  pthread_cond_init(&batch->done, NULL);
+  batch->workers = threads;
+
+  pthread_t workers[threads];
+  for (int i = 0; i < threads; ++i)
+  {
+    if (pthread_create(&workers[i], NULL, batch_worker, batch) != 0)
+      handle_error("pthread_create");
+  }
+
+  // One large buffer for all output, written in input order
+  static char out[1 << 20];
+  setvbuf(stdout, out, _IOFBF, sizeof(out));
+
+  int count;
+  while ((count = batch_read(batch, in, salt)) > 0)
+  {
+    pthread_mutex_lock(&batch->mutex);
+    batch->count = count;
+    batch->next = 0;
+    batch->finished = 0;
+    ++batch->generation;
+    pthread_cond_broadcast(&batch->work);
+    while (batch->finished != batch->workers)
+      pthread_cond_wait(&batch->done, &batch->mutex);
+    pthread_mutex_unlock(&batch->mutex);
+
+    for (int i = 0; i < count; ++i)
+    {
+      struct entry_t *entry = &batch->entries[i];
+      fputs(entry->hash, stdout);
+      if (tagged)
+      {
+        // Same "hash:password" lines as a potfile
+        fputc(':', stdout);
+        fputs(entry->password, stdout);
+      }
+      fputc('\n', stdout);
+    }
+  }
+  fflush(stdout);
+
+  pthread_mutex_lock(&batch->mutex);
+  batch->quit = true;
+  pthread_cond_broadcast(&batch->work);
+  pthread_mutex_unlock(&batch->mutex);
+  for (int i = 0; i < threads; ++i)
+    pthread_join(workers[i], NULL);
+
+  for (int i = 0; i < BATCH_SIZE; ++i)
+    free(batch->entries[i].line);
+  free(batch);
+}
+
 int
 main(int argc, char *argv[])
 {
   char *password = "abcd";
   char *salt = "hi";
+  char *input = NULL;
+  bool batch = false;
+  bool tagged = false;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
   int opt;
   opterr = 1;
-  while ((opt = getopt(argc, argv, "p:s:")) != -1)
+  while ((opt = getopt(argc, argv, "p:s:bf:j:t")) != -1)
   {
     switch (opt)
     {
@@ -21,12 +184,42 @@ main(int argc, char *argv[])
     case 's':
       salt = optarg;
       break;
+    case 'b':
+      batch = true;
+      break;
+    case 'f':
+      batch = true;
+      input = optarg;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 't':
+      tagged = true;
+      break;
     default:
       exit(1);
       break;
     }
   }
 
+  if (batch)
+  {
+    FILE *in = stdin;
+    if (input != NULL && strcmp(input, "-") != 0)
+    {
+      in = fopen(input, "r");
+      if (in == NULL)
+        handle_error("fopen");
+    }
+    if (threads < 1)
+      threads = 1;
+    batch_run(in, salt, threads, tagged);
+    if (in != stdin)
+      fclose(in);
+    return 0;
+  }
+
   char *hash = crypt(password, salt);
   printf("%s\n", hash);
   return 0;
@@ -2,47 +2,82 @@
 #include "generator.h"
 #include "iterative.h"
 #include "recursive.h"
+#include "wordlist.h"
+#include "markov.h"
 #include "singlethreaded.h"
+#include "trace.h"
+#include "arena.h"
+#include "memcost.h"
 
 #include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <alloca.h>
+#include <stdint.h>
 #include <unistd.h>
 
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+// alloca only guarantees the ABI stack alignment
+#define CACHE_ALLOCA(size) \
+    ((void *) (((uintptr_t) alloca((size) + CACHE_LINE) + CACHE_LINE - 1) \
+               & ~(uintptr_t) (CACHE_LINE - 1)))
+
 struct gn_context_t
 {
-    pthread_mutex_t mutex;
-    password_t password;
+    // Read by every worker before and after each task
     char *hash;
+    struct config_t *config;
+    struct arena_t crypt_arena;
     volatile bool found;
-    volatile bool done;
 
-    struct config_t *config;
+    password_t password CACHE_ALIGNED;
+
+    // Written by whoever holds the mutex, together with the iterator
+    pthread_mutex_t mutex CACHE_ALIGNED;
+    volatile bool done;
+    long long seq;
 
     union {
         struct iter_state_t iter_state[0];
         struct rec_state_t rec_state[0];
+        struct wl_state_t wl_state[0];
+        struct mk_state_t mk_state[0];
     };
 };
 
+struct gn_worker_t
+{
+    struct gn_context_t *context;
+    int index;
+};
+
 static void *
 gn_worker(void *arg)
 {
-    struct gn_context_t *context = (struct gn_context_t *) arg;
+    struct gn_worker_t *worker = (struct gn_worker_t *) arg;
+    struct gn_context_t *context = worker->context;
     struct config_t *config = context->config;
 
     struct st_context_t st_context;
     st_context.hash = context->hash;
-    st_context.cd.initialized = 0;
+    st_context.cd = arena_slot(&context->crypt_arena, worker->index);
+    st_context.stop = NULL;
+    trace_thread("gn_worker");
 
     while (true)
     {
         struct task_t task;
         pthread_mutex_lock(&context->mutex);
-        bool done = context->done;
-        if (!done)
+        uint64_t locked = trace_begin();
+        bool done = true;
+        // Skip the tasks belonging to other shards
+        while (done && !context->done)
         {
+            done = !shard_owns(config, context->seq++);
             switch (config->brute_mode)
             {
             case M_ITERATIVE:
@@ -54,23 +89,36 @@ gn_worker(void *arg)
                 task = *context->rec_state->task;
                 context->done = !rec_next(context->rec_state);
                 break;
+            case M_WORDLIST:
+            case M_HYBRID:
+            case M_HYBRID_PREFIX:
+                task = *context->wl_state->task;
+                context->done = !wl_next(context->wl_state);
+                break;
+            case M_MARKOV:
+                task = *context->mk_state->task;
+                context->done = !mk_next(context->mk_state);
+                break;
             default:
-                done = true;
+                context->done = true;
                 break;
             }
         }
+        trace_end("gn_lock", H_NONE, locked);
         pthread_mutex_unlock(&context->mutex);
 
         if (done || context->found) break;
 
         task.to = task.from;
         task.from = 0;
+        uint64_t start = trace_begin();
         if (process_task(&task, config, &st_context, st_password_handler))
         {
             memcpy(context->password, task.password, sizeof(task.password));
             context->found = true;
             context->done = true;
         }
+        trace_end("task", H_TASK, start);
     }
     return NULL;
 }
@@ -80,22 +128,33 @@ generator(struct task_t *task, struct config_t *config)
 {
     struct gn_context_t *context = NULL;
 
-    task->from = 2;
-    if (config->length < 3) task->from = 1;
+    task->from = split_point(config);
     task->to = config->length;
     switch (config->brute_mode)
     {
     case M_ITERATIVE:
-        context = alloca(sizeof(struct gn_context_t)
-                         + sizeof(struct iter_state_t));
+        context = CACHE_ALLOCA(sizeof(struct gn_context_t)
+                               + sizeof(struct iter_state_t));
         iter_init(context->iter_state, task, config->alphabet);
         break;
     case M_RECURSIVE:
     case M_REC_ITERATOR:
-        context = alloca(sizeof(struct gn_context_t)
-                         + sizeof(struct rec_state_t));
+        context = CACHE_ALLOCA(sizeof(struct gn_context_t)
+                               + sizeof(struct rec_state_t));
         rec_init(context->rec_state, task, config);
         break;
+    case M_WORDLIST:
+    case M_HYBRID:
+    case M_HYBRID_PREFIX:
+        context = CACHE_ALLOCA(sizeof(struct gn_context_t)
+                               + sizeof(struct wl_state_t));
+        wl_init(context->wl_state, task, config);
+        break;
+    case M_MARKOV:
+        context = CACHE_ALLOCA(sizeof(struct gn_context_t)
+                               + sizeof(struct mk_state_t));
+        mk_init(context->mk_state, task, config);
+        break;
     }
 
     context->hash = config->hash;
@@ -104,15 +163,24 @@ generator(struct task_t *task, struct config_t *config)
     context->config = config;
     context->done = false;
     context->found = false;
+    context->seq = 0;
 
-    int cpu_count = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    // The calling thread is one of the workers
+    int cpu_count = memcost_threads(config, thread_count(config)) - 1;
+    if (arena_init(&context->crypt_arena, sizeof(struct crypt_data), cpu_count + 1) == -1)
+        handle_error("mmap");
     pthread_t threads[cpu_count];
+    struct gn_worker_t workers[cpu_count + 1];
+    for (int i = 0; i <= cpu_count; ++i)
+    {
+        workers[i] = (struct gn_worker_t) { context, i };
+    }
     for (int i = 0; i < cpu_count; ++i)
     {
-        pthread_create(&threads[i], NULL, gn_worker, (void *) context);
+        pthread_create(&threads[i], NULL, gn_worker, (void *) &workers[i]);
     }
 
-    gn_worker(context);
+    gn_worker(&workers[cpu_count]);
 
     for (int i = 0; i < cpu_count; ++i)
     {
@@ -120,6 +188,7 @@ generator(struct task_t *task, struct config_t *config)
     }
 
     memcpy(task->password, context->password, sizeof(context->password));
+    arena_destroy(&context->crypt_arena);
 
     return context->found;
 }
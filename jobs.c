@@ -0,0 +1,143 @@
+#include "jobs.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+static void
+job_copy(char *dst, const char *src, size_t size, const char *what, int line)
+{
+    if (strlen(src) >= size)
+    {
+        fprintf(stderr, "Job on line %d: %s is too long\n", line, what);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(dst, src);
+}
+
+static enum brute_mode_t
+job_mode(const char *mode, int line)
+{
+    // Wordlists and Markov models would have to exist on every client
+    if (strcmp(mode, "i") == 0) return M_ITERATIVE;
+    if (strcmp(mode, "r") == 0) return M_RECURSIVE;
+    if (strcmp(mode, "y") == 0) return M_REC_ITERATOR;
+    fprintf(stderr, "Job on line %d: unknown mode '%s'\n", line, mode);
+    exit(EXIT_FAILURE);
+}
+
+// One job per line: hash length [alphabet [mode [priority [weight]]]],
+// missing fields are taken from the command line
+struct job_list_t *
+jobs_load(const char *path, struct config_t *config)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        handle_error("fopen");
+
+    struct job_list_t *list = calloc(1, sizeof(struct job_list_t));
+    if (list == NULL)
+        handle_error("Couldn't allocate space for job_list_t");
+    int capacity = 0;
+
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        ++line_no;
+        char *fields[6];
+        int count = 0;
+        for (char *token = strtok(line, " \t\r\n");
+             token != NULL && token[0] != '#' && count < 6;
+             token = strtok(NULL, " \t\r\n"))
+        {
+            fields[count++] = token;
+        }
+        if (count == 0)
+            continue;
+        if (count < 2)
+        {
+            fprintf(stderr, "Job on line %d: expected hash and length\n", line_no);
+            exit(EXIT_FAILURE);
+        }
+
+        if (list->count == capacity)
+        {
+            capacity = (capacity == 0) ? 8 : capacity * 2;
+            list->jobs = realloc(list->jobs, capacity * sizeof(struct job_t));
+            if (list->jobs == NULL)
+                handle_error("Couldn't reallocate space for jobs");
+        }
+        struct job_t *job = &list->jobs[list->count];
+        job_from_config(job, list->count, config);
+        ++list->count;
+
+        job_copy(job->desc.hash, fields[0], JOB_HASH_SIZE, "hash", line_no);
+        job->desc.length = atoi(fields[1]);
+        if (count > 2)
+            job_copy(job->desc.alphabet, fields[2], JOB_ALPHABET_SIZE,
+                     "alphabet", line_no);
+        if (count > 3)
+            job->desc.brute_mode = job_mode(fields[3], line_no);
+        if (count > 4)
+            job->priority = atoi(fields[4]);
+        if (count > 5)
+            job->weight = atoi(fields[5]);
+
+        if (job->desc.length <= 0 || job->desc.length >= PASSWORD_SIZE)
+        {
+            fprintf(stderr, "Job on line %d: bad length\n", line_no);
+            exit(EXIT_FAILURE);
+        }
+        if (job->weight <= 0)
+            job->weight = 1;
+    }
+
+    fclose(file);
+    return list;
+}
+
+void
+jobs_free(struct job_list_t *list)
+{
+    free(list->jobs);
+    free(list);
+}
+
+void
+job_from_config(struct job_t *job, int id, struct config_t *config)
+{
+    memset(job, 0, sizeof(*job));
+    job->desc.id = id;
+    job->desc.length = config->length;
+    job->desc.brute_mode = config->brute_mode;
+    job_copy(job->desc.hash, config->hash, JOB_HASH_SIZE, "hash", 0);
+    job_copy(job->desc.alphabet, config->alphabet, JOB_ALPHABET_SIZE,
+             "alphabet", 0);
+    job->priority = 0;
+    job->weight = 1;
+}
+
+// Strict priority between jobs, weighted-fair sharing within a priority
+bool
+job_before(const struct job_t *a, long long a_dispatched,
+           const struct job_t *b, long long b_dispatched)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return a_dispatched * b->weight < b_dispatched * a->weight;
+}
+
+// The config keeps pointing into the descriptor, which must outlive it
+void
+job_apply(struct job_desc_t *desc, struct config_t *config)
+{
+    config->hash = desc->hash;
+    config->alphabet = desc->alphabet;
+    config->length = desc->length;
+    config->brute_mode = desc->brute_mode;
+}
@@ -0,0 +1,51 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "common.h"
+
+#define JOB_HASH_SIZE 128
+#define JOB_ALPHABET_SIZE 128
+
+// Everything a client needs to work on tasks of a job, sent with CMD_JOB
+struct job_desc_t
+{
+    int id;
+    int length;
+    enum brute_mode_t brute_mode;
+    char hash[JOB_HASH_SIZE];
+    char alphabet[JOB_ALPHABET_SIZE];
+};
+
+struct job_t
+{
+    struct job_desc_t desc;
+    // Higher priorities are served first, equal ones share the fleet
+    // in proportion to their weights
+    int priority, weight;
+};
+
+struct job_list_t
+{
+    struct job_t *jobs;
+    int count;
+};
+
+struct job_list_t *
+jobs_load(const char *path, struct config_t *);
+
+void
+jobs_free(struct job_list_t *);
+
+void
+job_from_config(struct job_t *, int id, struct config_t *);
+
+void
+job_apply(struct job_desc_t *, struct config_t *);
+
+// Dispatch order of two jobs with queued tasks, given how many tasks
+// each one had dispatched so far
+bool
+job_before(const struct job_t *a, long long a_dispatched,
+           const struct job_t *b, long long b_dispatched);
+
+#endif // JOBS_H
@@ -0,0 +1,111 @@
+#include "kernels.h"
+#include "common.h"
+
+#include <string.h>
+
+// Enumerators for a fixed number of positions, in the same order as
+// bruteforce_iter: the last position changes fastest. Unlike iter_next
+// they don't re-check bounds per candidate, and the alphabet is copied
+// to a local array the handler can't alias, so it stays in cache/regs.
+
+#define KERNEL_CHECK(pos, i)                                \
+    pw[pos] = alph[i];                                      \
+    if (handler(context, task)) return true;
+
+#define KERNEL_LOOP(pos, body)                              \
+    for (int i##pos = 0; i##pos < k; ++i##pos)              \
+    {                                                       \
+        pw[pos] = alph[i##pos];                             \
+        body                                                \
+    }
+
+// Innermost position unrolled by four
+#define KERNEL_INNER(pos)                                   \
+    {                                                       \
+        int i = 0;                                          \
+        for (; i + 4 <= k; i += 4)                          \
+        {                                                   \
+            KERNEL_CHECK(pos, i)                            \
+            KERNEL_CHECK(pos, i + 1)                        \
+            KERNEL_CHECK(pos, i + 2)                        \
+            KERNEL_CHECK(pos, i + 3)                        \
+        }                                                   \
+        for (; i < k; ++i)                                  \
+        {                                                   \
+            KERNEL_CHECK(pos, i)                            \
+        }                                                   \
+    }
+
+#define KERNEL_BODY_1  KERNEL_INNER(0)
+#define KERNEL_BODY_2  KERNEL_LOOP(0, KERNEL_INNER(1))
+#define KERNEL_BODY_3  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_INNER(2)))
+#define KERNEL_BODY_4  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_INNER(3))))
+#define KERNEL_BODY_5  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_INNER(4)))))
+#define KERNEL_BODY_6  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_INNER(5))))))
+#define KERNEL_BODY_7  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_LOOP(5, \
+                       KERNEL_INNER(6)))))))
+#define KERNEL_BODY_8  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_LOOP(5, \
+                       KERNEL_LOOP(6, KERNEL_INNER(7))))))))
+#define KERNEL_BODY_9  KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_LOOP(5, \
+                       KERNEL_LOOP(6, KERNEL_LOOP(7, KERNEL_INNER(8)))))))))
+#define KERNEL_BODY_10 KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_LOOP(5, \
+                       KERNEL_LOOP(6, KERNEL_LOOP(7, KERNEL_LOOP(8, \
+                       KERNEL_INNER(9))))))))))
+#define KERNEL_BODY_11 KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_LOOP(5, \
+                       KERNEL_LOOP(6, KERNEL_LOOP(7, KERNEL_LOOP(8, \
+                       KERNEL_LOOP(9, KERNEL_INNER(10)))))))))))
+#define KERNEL_BODY_12 KERNEL_LOOP(0, KERNEL_LOOP(1, KERNEL_LOOP(2, \
+                       KERNEL_LOOP(3, KERNEL_LOOP(4, KERNEL_LOOP(5, \
+                       KERNEL_LOOP(6, KERNEL_LOOP(7, KERNEL_LOOP(8, \
+                       KERNEL_LOOP(9, KERNEL_LOOP(10, KERNEL_INNER(11))))))))))))
+
+#define DEFINE_KERNEL(n)                                    \
+    static bool                                             \
+    kernel_##n(struct task_t *task,                         \
+               struct config_t *config,                     \
+               void *context,                               \
+               password_handler_t handler)                  \
+    {                                                       \
+        char alph[256];                                     \
+        int k = strlen(config->alphabet);                   \
+        memcpy(alph, config->alphabet, k);                  \
+        char *pw = task->password + task->from;             \
+        KERNEL_BODY_##n                                     \
+        return false;                                       \
+    }
+
+DEFINE_KERNEL(1)
+DEFINE_KERNEL(2)
+DEFINE_KERNEL(3)
+DEFINE_KERNEL(4)
+DEFINE_KERNEL(5)
+DEFINE_KERNEL(6)
+DEFINE_KERNEL(7)
+DEFINE_KERNEL(8)
+DEFINE_KERNEL(9)
+DEFINE_KERNEL(10)
+DEFINE_KERNEL(11)
+DEFINE_KERNEL(12)
+
+static const enumerator_kernel_t kernels[KERNEL_MAX_WIDTH + 1] = {
+    NULL, kernel_1, kernel_2, kernel_3, kernel_4, kernel_5, kernel_6,
+    kernel_7, kernel_8, kernel_9, kernel_10, kernel_11, kernel_12,
+};
+
+enumerator_kernel_t
+kernel_select(struct task_t *task, struct config_t *config)
+{
+    int width = task->to - task->from;
+    if (width < 1 || width > KERNEL_MAX_WIDTH
+        || strlen(config->alphabet) >= 256)
+        return NULL;
+    return kernels[width];
+}
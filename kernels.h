@@ -0,0 +1,17 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+// Widest task enumerated by a specialized kernel
+#define KERNEL_MAX_WIDTH 12
+
+typedef bool (*enumerator_kernel_t)(struct task_t *, struct config_t *,
+                                    void *context, password_handler_t);
+
+enumerator_kernel_t
+kernel_select(struct task_t *, struct config_t *);
+
+#endif // KERNELS_H
@@ -0,0 +1,64 @@
+#include "latch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+void
+latch_init(struct latch_t *latch, int shard_count)
+{
+    if (arena_init(&latch->shards, sizeof(struct latch_shard_t), shard_count) == -1)
+        handle_error("mmap");
+    latch->shard_count = shard_count;
+    latch->waiting = false;
+    pthread_mutex_init(&latch->mutex, NULL);
+    pthread_cond_init(&latch->cond, NULL);
+}
+
+void
+latch_destroy(struct latch_t *latch)
+{
+    arena_destroy(&latch->shards);
+    pthread_mutex_destroy(&latch->mutex);
+    pthread_cond_destroy(&latch->cond);
+}
+
+static long long
+latch_count(struct latch_t *latch)
+{
+    long long count = 0;
+    for (int i = 0; i < latch->shard_count; ++i)
+    {
+        struct latch_shard_t *shard = arena_slot(&latch->shards, i);
+        count += __atomic_load_n(&shard->count, __ATOMIC_SEQ_CST);
+    }
+    return count;
+}
+
+void
+latch_arrive(struct latch_t *latch, int shard)
+{
+    struct latch_shard_t *own = arena_slot(&latch->shards, shard);
+    // Sequentially consistent against the waiter: either it sees this
+    // arrival in its count or this sees it waiting
+    __atomic_store_n(&own->count, own->count + 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&latch->waiting, __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock(&latch->mutex);
+    pthread_cond_signal(&latch->cond);
+    pthread_mutex_unlock(&latch->mutex);
+}
+
+void
+latch_wait(struct latch_t *latch, long long target, volatile bool *abort)
+{
+    pthread_mutex_lock(&latch->mutex);
+    __atomic_store_n(&latch->waiting, true, __ATOMIC_SEQ_CST);
+    while (latch_count(latch) < target && !(abort != NULL && *abort))
+        pthread_cond_wait(&latch->cond, &latch->mutex);
+    __atomic_store_n(&latch->waiting, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&latch->mutex);
+}
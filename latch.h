@@ -0,0 +1,39 @@
+#ifndef LATCH_H
+#define LATCH_H
+
+#include "common.h"
+#include "arena.h"
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// Completion counter split in per-worker shards on separate cache lines.
+// Arrivals only touch their own shard until somebody waits on the latch.
+struct latch_shard_t
+{
+    long long count;
+};
+
+struct latch_t
+{
+    struct arena_t shards;
+    int shard_count;
+    bool waiting;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+void
+latch_init(struct latch_t *, int shard_count);
+
+void
+latch_destroy(struct latch_t *);
+
+void
+latch_arrive(struct latch_t *, int shard);
+
+// Blocks until target arrivals were counted or *abort is set
+void
+latch_wait(struct latch_t *, long long target, volatile bool *abort);
+
+#endif // LATCH_H
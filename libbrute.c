@@ -0,0 +1,443 @@
+#include "brute.h"
+
+#include "common.h"
+#include "jobs.h"
+#include "singlethreaded.h"
+#include "iterative.h"
+#include "arena.h"
+#include "memcost.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+_Static_assert(BRUTE_PASSWORD_SIZE == PASSWORD_SIZE, "password size mismatch");
+
+struct lb_job_t
+{
+    struct job_desc_t desc;
+    struct config_t config;
+    // Split lazily like the generator mode, under the session mutex
+    struct task_t task;
+    struct iter_state_t iter_state;
+    bool exhausted;
+    long long task_count, next, done;
+    // Memory-hard hashes only get as many threads as fit in memory
+    int running, max_running;
+    bool found, cancelled;
+    // Finished by brute_session_destroy, notified once the pool is gone
+    bool notify;
+    // Checked for every candidate so running tasks end early
+    volatile bool stop;
+    enum brute_result_t result;
+    password_t password;
+};
+
+struct lb_thread_t;
+
+struct brute_session_t
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond, done_cond;
+
+    struct lb_job_t **jobs;
+    int job_count, job_capacity;
+    // Jobs before this one have all been handed out
+    int first_active;
+    bool shutdown;
+
+    struct lb_thread_t *threads;
+    int thread_count;
+    struct arena_t crypt_arena;
+
+    brute_callback_t callback;
+    void *user;
+};
+
+struct lb_thread_t
+{
+    pthread_t id;
+    struct brute_session_t *session;
+    int index;
+};
+
+struct lb_worker_t
+{
+    struct st_context_t st_context;
+    struct lb_job_t *job;
+    bool matched;
+};
+
+static bool
+lb_password_handler(void *context, struct task_t *task)
+{
+    struct lb_worker_t *worker = (struct lb_worker_t *) context;
+    if (worker->job->stop)
+        return true;
+    if (!st_password_handler(&worker->st_context, task))
+        return false;
+    worker->matched = true;
+    return true;
+}
+
+// Settles the result once nothing runs anymore, under the session mutex
+static bool
+lb_finish(struct brute_session_t *session, struct lb_job_t *job)
+{
+    if (job->result != BRUTE_RUNNING || job->running != 0)
+        return false;
+    if (!job->stop && !job->exhausted)
+        return false;
+
+    if (job->found)
+        job->result = BRUTE_FOUND;
+    else if (job->cancelled)
+        job->result = BRUTE_CANCELLED;
+    else
+        job->result = BRUTE_NOT_FOUND;
+    pthread_cond_broadcast(&session->done_cond);
+    return true;
+}
+
+static void
+lb_notify(struct brute_session_t *session, int job_id,
+          enum brute_result_t result, const char *password)
+{
+    if (session->callback != NULL)
+        session->callback(session->user, job_id, result,
+                          (result == BRUTE_FOUND) ? password : NULL);
+}
+
+static struct lb_job_t *
+lb_next_task(struct brute_session_t *session, int *job_id, struct task_t *task)
+{
+    for (int i = session->first_active; i < session->job_count; ++i)
+    {
+        struct lb_job_t *job = session->jobs[i];
+        if (job->stop || job->exhausted)
+        {
+            if (i == session->first_active)
+                ++session->first_active;
+            continue;
+        }
+        if (job->running >= job->max_running)
+            continue;
+        *task = job->task;
+        job->exhausted = !iter_next(&job->iter_state);
+        ++job->next;
+        ++job->running;
+        *job_id = i;
+        return job;
+    }
+    return NULL;
+}
+
+static void *
+lb_worker(void *arg)
+{
+    struct lb_thread_t *thread = (struct lb_thread_t *) arg;
+    struct brute_session_t *session = thread->session;
+
+    struct lb_worker_t worker;
+    worker.st_context.cd = arena_slot(&session->crypt_arena, thread->index);
+    worker.st_context.stop = NULL;
+
+    pthread_mutex_lock(&session->mutex);
+    while (true)
+    {
+        struct task_t task;
+        int job_id;
+        struct lb_job_t *job = lb_next_task(session, &job_id, &task);
+        if (job == NULL)
+        {
+            if (session->shutdown)
+                break;
+            pthread_cond_wait(&session->work_cond, &session->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&session->mutex);
+
+        worker.st_context.hash = job->config.hash;
+        worker.job = job;
+        worker.matched = false;
+        task.to = task.from;
+        task.from = 0;
+        process_task(&task, &job->config, &worker, lb_password_handler);
+
+        pthread_mutex_lock(&session->mutex);
+        ++job->done;
+        --job->running;
+        if (worker.matched && !job->stop)
+        {
+            memcpy(job->password, task.password, sizeof(task.password));
+            job->found = true;
+            job->stop = true;
+        }
+        if (lb_finish(session, job))
+        {
+            password_t password;
+            memcpy(password, job->password, sizeof(password));
+            enum brute_result_t result = job->result;
+            pthread_mutex_unlock(&session->mutex);
+            lb_notify(session, job_id, result, password);
+            pthread_mutex_lock(&session->mutex);
+        }
+    }
+    pthread_mutex_unlock(&session->mutex);
+    return NULL;
+}
+
+int
+brute_session_create(struct brute_session_t **out,
+                     int threads,
+                     brute_callback_t callback,
+                     void *user)
+{
+    if (out == NULL || threads < 0)
+        return BRUTE_EINVAL;
+    if (threads == 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+
+    struct brute_session_t *session = calloc(1, sizeof(struct brute_session_t));
+    if (session == NULL)
+        return BRUTE_ENOMEM;
+    session->threads = calloc(threads, sizeof(struct lb_thread_t));
+    if (session->threads == NULL)
+    {
+        free(session);
+        return BRUTE_ENOMEM;
+    }
+    if (arena_init(&session->crypt_arena, sizeof(struct crypt_data), threads) == -1)
+    {
+        free(session->threads);
+        free(session);
+        return BRUTE_ENOMEM;
+    }
+    pthread_mutex_init(&session->mutex, NULL);
+    pthread_cond_init(&session->work_cond, NULL);
+    pthread_cond_init(&session->done_cond, NULL);
+    session->callback = callback;
+    session->user = user;
+
+    for (; session->thread_count < threads; ++session->thread_count)
+    {
+        struct lb_thread_t *thread = &session->threads[session->thread_count];
+        thread->session = session;
+        thread->index = session->thread_count;
+        if (pthread_create(&thread->id, NULL, lb_worker, thread) != 0)
+        {
+            brute_session_destroy(session);
+            return BRUTE_ETHREAD;
+        }
+    }
+
+    *out = session;
+    return BRUTE_OK;
+}
+
+void
+brute_session_destroy(struct brute_session_t *session)
+{
+    pthread_mutex_lock(&session->mutex);
+    session->shutdown = true;
+    for (int i = 0; i < session->job_count; ++i)
+    {
+        struct lb_job_t *job = session->jobs[i];
+        if (job->result != BRUTE_RUNNING || job->stop)
+            continue;
+        job->cancelled = true;
+        job->stop = true;
+        job->notify = lb_finish(session, job);
+    }
+    pthread_cond_broadcast(&session->work_cond);
+    pthread_mutex_unlock(&session->mutex);
+
+    for (int i = 0; i < session->thread_count; ++i)
+        pthread_join(session->threads[i].id, NULL);
+
+    for (int i = 0; i < session->job_count; ++i)
+    {
+        if (session->jobs[i]->notify)
+            lb_notify(session, i, BRUTE_CANCELLED, NULL);
+        free(session->jobs[i]);
+    }
+    free(session->jobs);
+    free(session->threads);
+    arena_destroy(&session->crypt_arena);
+    pthread_mutex_destroy(&session->mutex);
+    pthread_cond_destroy(&session->work_cond);
+    pthread_cond_destroy(&session->done_cond);
+    free(session);
+}
+
+static int
+lb_job_init(struct lb_job_t *job, const struct brute_job_t *spec)
+{
+    if (spec->hash == NULL || strlen(spec->hash) >= JOB_HASH_SIZE)
+        return BRUTE_EINVAL;
+    if (spec->alphabet == NULL || spec->alphabet[0] == '\0'
+        || strlen(spec->alphabet) >= JOB_ALPHABET_SIZE)
+        return BRUTE_EINVAL;
+    if (spec->length <= 0 || spec->length >= PASSWORD_SIZE)
+        return BRUTE_EINVAL;
+
+    switch (spec->mode)
+    {
+    case BRUTE_ITERATIVE:
+        job->desc.brute_mode = M_ITERATIVE;
+        break;
+    case BRUTE_RECURSIVE:
+        job->desc.brute_mode = M_RECURSIVE;
+        break;
+    case BRUTE_REC_ITERATOR:
+#ifdef __APPLE__
+        return BRUTE_EINVAL;
+#endif
+        job->desc.brute_mode = M_REC_ITERATOR;
+        break;
+    default:
+        return BRUTE_EINVAL;
+    }
+    strcpy(job->desc.hash, spec->hash);
+    strcpy(job->desc.alphabet, spec->alphabet);
+    job->desc.length = spec->length;
+
+    job->config.markov_level = -1;
+    job->config.shard_count = 1;
+    job_apply(&job->desc, &job->config);
+
+    struct task_t *task = &job->task;
+    task->from = split_point(&job->config);
+    task->to = job->config.length;
+    task->password[job->config.length] = '\0';
+    iter_init(&job->iter_state, task, job->config.alphabet);
+
+    // Saturates, it only feeds progress reports
+    job->task_count = 1;
+    size_t size = strlen(job->config.alphabet);
+    for (int i = task->from; i < task->to; ++i)
+        job->task_count = (job->task_count > LLONG_MAX / size)
+            ? LLONG_MAX : job->task_count * size;
+    job->result = BRUTE_RUNNING;
+    return BRUTE_OK;
+}
+
+int
+brute_submit(struct brute_session_t *session,
+             const struct brute_job_t *spec,
+             int *job_id)
+{
+    if (session == NULL || spec == NULL)
+        return BRUTE_EINVAL;
+
+    struct lb_job_t *job = calloc(1, sizeof(struct lb_job_t));
+    if (job == NULL)
+        return BRUTE_ENOMEM;
+    int status = lb_job_init(job, spec);
+    if (status != BRUTE_OK)
+    {
+        free(job);
+        return status;
+    }
+    // Silent, the library doesn't print on behalf of its host
+    job->max_running = memcost_limit(&job->config, session->thread_count);
+
+    pthread_mutex_lock(&session->mutex);
+    if (session->job_count == session->job_capacity)
+    {
+        int capacity = (session->job_capacity == 0) ? 8 : session->job_capacity * 2;
+        struct lb_job_t **jobs = realloc(session->jobs, capacity * sizeof(*jobs));
+        if (jobs == NULL)
+        {
+            pthread_mutex_unlock(&session->mutex);
+            free(job);
+            return BRUTE_ENOMEM;
+        }
+        session->jobs = jobs;
+        session->job_capacity = capacity;
+    }
+    int id = session->job_count++;
+    session->jobs[id] = job;
+    pthread_cond_broadcast(&session->work_cond);
+    pthread_mutex_unlock(&session->mutex);
+
+    if (job_id != NULL)
+        *job_id = id;
+    return BRUTE_OK;
+}
+
+int
+brute_poll(struct brute_session_t *session,
+           int job_id,
+           struct brute_progress_t *progress)
+{
+    pthread_mutex_lock(&session->mutex);
+    if (job_id < 0 || job_id >= session->job_count)
+    {
+        pthread_mutex_unlock(&session->mutex);
+        return BRUTE_ENOJOB;
+    }
+    struct lb_job_t *job = session->jobs[job_id];
+    progress->result = job->result;
+    progress->tasks_done = job->done;
+    progress->tasks_total = job->task_count;
+    pthread_mutex_unlock(&session->mutex);
+    return BRUTE_OK;
+}
+
+int
+brute_wait(struct brute_session_t *session,
+           int job_id,
+           enum brute_result_t *result,
+           char *password)
+{
+    pthread_mutex_lock(&session->mutex);
+    if (job_id < 0 || job_id >= session->job_count)
+    {
+        pthread_mutex_unlock(&session->mutex);
+        return BRUTE_ENOJOB;
+    }
+    struct lb_job_t *job = session->jobs[job_id];
+    while (job->result == BRUTE_RUNNING)
+        pthread_cond_wait(&session->done_cond, &session->mutex);
+    if (result != NULL)
+        *result = job->result;
+    if (password != NULL)
+    {
+        if (job->result == BRUTE_FOUND)
+            memcpy(password, job->password, sizeof(job->password));
+        else
+            password[0] = '\0';
+    }
+    pthread_mutex_unlock(&session->mutex);
+    return BRUTE_OK;
+}
+
+int
+brute_cancel(struct brute_session_t *session, int job_id)
+{
+    pthread_mutex_lock(&session->mutex);
+    if (job_id < 0 || job_id >= session->job_count)
+    {
+        pthread_mutex_unlock(&session->mutex);
+        return BRUTE_ENOJOB;
+    }
+    struct lb_job_t *job = session->jobs[job_id];
+    bool finished = false;
+    if (!job->stop)
+    {
+        job->cancelled = true;
+        job->stop = true;
+        finished = lb_finish(session, job);
+    }
+    pthread_mutex_unlock(&session->mutex);
+
+    // Otherwise the last running task reports the cancellation
+    if (finished)
+        lb_notify(session, job_id, BRUTE_CANCELLED, NULL);
+    return BRUTE_OK;
+}
@@ -2,6 +2,17 @@
 #include "singlethreaded.h"
 #include "multithreaded.h"
 #include "generator.h"
+#include "wordlist.h"
+#include "rules.h"
+#include "markov.h"
+#include "table.h"
+#include "potfile.h"
+#include "trace.h"
+#include "perf.h"
+#include "stream.h"
+#include "bcrypt.h"
+#include "des.h"
+#include "sim.h"
 
 #include "client.h"
 #include "server.h"
@@ -11,12 +22,60 @@
 #include <stdbool.h>
 #include <getopt.h>
 
+// Values for options without a short form
+enum long_opt_t
+{
+    OPT_MARKOV_TRAIN = 256,
+    OPT_MARKOV_LEVEL,
+    OPT_SHARD,
+    OPT_BUILD_TABLE,
+    OPT_TABLE,
+    OPT_POTFILE,
+    OPT_RESERVE,
+    OPT_TRACE,
+    OPT_PERF,
+    OPT_JOBS,
+    OPT_STDOUT,
+    OPT_MEM_BUDGET,
+    OPT_BCRYPT_ENGINE,
+    OPT_DES_ENGINE,
+    OPT_HYBRID,
+    OPT_HYBRID_PREFIX,
+    OPT_SIMULATE,
+    OPT_RELAY,
+    OPT_SPLIT,
+};
+
+static const struct option long_opts[] = {
+    { "markov-train", required_argument, NULL, OPT_MARKOV_TRAIN },
+    { "markov-level", required_argument, NULL, OPT_MARKOV_LEVEL },
+    { "shard", required_argument, NULL, OPT_SHARD },
+    { "build-table", required_argument, NULL, OPT_BUILD_TABLE },
+    { "table", required_argument, NULL, OPT_TABLE },
+    { "potfile", required_argument, NULL, OPT_POTFILE },
+    { "reserve", required_argument, NULL, OPT_RESERVE },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "perf", no_argument, NULL, OPT_PERF },
+    { "jobs", required_argument, NULL, OPT_JOBS },
+    { "stdout", no_argument, NULL, OPT_STDOUT },
+    { "mem-budget", required_argument, NULL, OPT_MEM_BUDGET },
+    { "bcrypt-engine", required_argument, NULL, OPT_BCRYPT_ENGINE },
+    { "des-engine", required_argument, NULL, OPT_DES_ENGINE },
+    { "hybrid", required_argument, NULL, OPT_HYBRID },
+    { "hybrid-prefix", required_argument, NULL, OPT_HYBRID_PREFIX },
+    { "simulate", required_argument, NULL, OPT_SIMULATE },
+    { "relay", required_argument, NULL, OPT_RELAY },
+    { "split", required_argument, NULL, OPT_SPLIT },
+    { NULL, 0, NULL, 0 },
+};
+
 void
 parse_opts(struct config_t *config, int argc, char *argv[])
 {
     int opt;
     opterr = 1;
-    while ((opt = getopt(argc, argv, "irymsgxca:l:h:j:p:")) != -1)
+    while ((opt = getopt_long(argc, argv, "irymsgxca:l:h:j:p:t:w:R:M:",
+                              long_opts, NULL)) != -1)
     {
         switch (opt)
         {
@@ -33,6 +92,96 @@ parse_opts(struct config_t *config, int argc, char *argv[])
             exit(EXIT_FAILURE);
 #endif
             break;
+        case 'w':
+            config->brute_mode = M_WORDLIST;
+            config->wordlist_path = optarg;
+            break;
+        case OPT_HYBRID:
+            config->brute_mode = M_HYBRID;
+            config->wordlist_path = optarg;
+            break;
+        case OPT_HYBRID_PREFIX:
+            config->brute_mode = M_HYBRID_PREFIX;
+            config->wordlist_path = optarg;
+            break;
+        case 'R':
+            config->rules_path = optarg;
+            break;
+        case 'M':
+            config->brute_mode = M_MARKOV;
+            config->markov_path = optarg;
+            break;
+        case OPT_MARKOV_TRAIN:
+            config->markov_corpus = optarg;
+            break;
+        case OPT_MARKOV_LEVEL:
+            config->markov_level = atoi(optarg);
+            break;
+        case OPT_SHARD:
+            if (sscanf(optarg, "%d/%d", &config->shard_index, &config->shard_count) != 2
+                || config->shard_count < 1
+                || config->shard_index < 0
+                || config->shard_index >= config->shard_count)
+            {
+                fprintf(stderr, "--shard expects i/N with 0 <= i < N\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_BUILD_TABLE:
+            config->run_mode = M_BUILD_TABLE;
+            config->table_path = optarg;
+            break;
+        case OPT_TABLE:
+            config->run_mode = M_TABLE;
+            config->table_path = optarg;
+            break;
+        case OPT_POTFILE:
+            config->potfile_path = optarg;
+            break;
+        case OPT_RESERVE:
+            config->reserved_cores = atoi(optarg);
+            break;
+        case OPT_TRACE:
+            config->trace_path = optarg;
+            trace_enabled = true;
+            break;
+        case OPT_PERF:
+            perf_enabled = true;
+            break;
+        case OPT_JOBS:
+            config->jobs_path = optarg;
+            break;
+        case OPT_STDOUT:
+            config->run_mode = M_STDOUT;
+            break;
+        case OPT_SIMULATE:
+            config->run_mode = M_SIMULATE;
+            config->sim_path = optarg;
+            break;
+        case OPT_RELAY:
+            config->run_mode = M_RELAY;
+            config->relay_port = atoi(optarg);
+            break;
+        case OPT_SPLIT:
+            config->split = atoi(optarg);
+            break;
+        case OPT_MEM_BUDGET:
+            config->mem_budget = atoi(optarg);
+            break;
+        case OPT_BCRYPT_ENGINE:
+            if (!bcrypt_select(optarg))
+            {
+                fprintf(stderr, "--bcrypt-engine expects auto, crypt, lanes or avx2\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_DES_ENGINE:
+            if (!des_select(optarg))
+            {
+                fprintf(stderr, "--des-engine expects crypt or incremental\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'a':
             config->alphabet = optarg;
             break;
@@ -48,6 +197,9 @@ parse_opts(struct config_t *config, int argc, char *argv[])
         case 'p':
             config->port = atoi(optarg);
             break;
+        case 't':
+            config->threads = atoi(optarg);
+            break;
         case 's':
             config->run_mode = M_SINGLE;
             break;
@@ -81,11 +233,96 @@ main(int argc, char *argv[])
         .hash = "hiwMxUWeODzGE", // hi + ccc
         .address = "127.0.0.1",
         .port = 9000,
+        .relay_port = 0,
+        .wordlist_path = NULL,
+        .wordlist = NULL,
+        .rules_path = NULL,
+        .rules = NULL,
+        .markov_path = NULL,
+        .markov_corpus = NULL,
+        .markov = NULL,
+        .markov_level = -1,
+        .shard_index = 0,
+        .shard_count = 1,
+        .table_path = NULL,
+        .potfile_path = NULL,
+        .reserved_cores = 1,
+        .trace_path = NULL,
+        .jobs_path = NULL,
+        .sim_path = NULL,
+        .split = 0,
+        .threads = 0,
+        .mem_budget = 0,
     };
     parse_opts(&config, argc, argv);
 
+    if (config.markov_corpus != NULL)
+    {
+        if (config.markov_path == NULL)
+        {
+            fprintf(stderr, "--markov-train needs a model path in -M\n");
+            exit(EXIT_FAILURE);
+        }
+        markov_train(config.markov_corpus, config.markov_path);
+        return 0;
+    }
+    if (config.run_mode == M_BUILD_TABLE)
+    {
+        table_build(&config);
+        return 0;
+    }
+
+    if (config.jobs_path != NULL && config.run_mode != M_SERVER
+        && config.run_mode != M_SIMULATE)
+    {
+        fprintf(stderr, "--jobs needs the server mode or --simulate\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Known hashes are answered before any workers or sockets are set up
+    bool own_hash = (config.run_mode != M_CLIENT && config.run_mode != M_RELAY
+                     && config.run_mode != M_STDOUT && config.run_mode != M_SIMULATE
+                     && config.jobs_path == NULL);
+    if (config.potfile_path != NULL && own_hash)
+    {
+        struct potfile_t *pot = potfile_load(config.potfile_path);
+        const char *password = potfile_find(pot, config.hash);
+        if (password != NULL)
+            printf("Password found: '%s'\n", password);
+        potfile_free(pot);
+        if (password != NULL)
+            return 0;
+    }
+
     struct task_t task;
     task.password[config.length] = '\0';
+    task.offset = task.end = 0;
+    bool hybrid = (config.brute_mode == M_HYBRID
+                   || config.brute_mode == M_HYBRID_PREFIX);
+    if (config.rules_path != NULL && config.brute_mode != M_WORDLIST)
+    {
+        fprintf(stderr, "Rules only apply to plain wordlists\n");
+        exit(EXIT_FAILURE);
+    }
+    if (config.brute_mode == M_WORDLIST || hybrid)
+    {
+        config.wordlist = wordlist_open(config.wordlist_path);
+        task.end = config.wordlist->size;
+        if (config.shard_count > 1)
+            wl_shard(config.wordlist, &task, &config);
+    }
+    if (config.brute_mode == M_MARKOV)
+    {
+        config.markov = markov_load(config.markov_path, &config);
+        task.end = markov_tasks(config.markov);
+        markov_report(config.markov);
+        if (config.shard_count > 1)
+            markov_shard(config.markov, &task, &config);
+    }
+    if (config.rules_path != NULL)
+        config.rules = rules_load(config.rules_path);
+
+    trace_thread("main");
 
     bool found;
     switch (config.run_mode)
@@ -105,12 +342,48 @@ main(int argc, char *argv[])
     case M_CLIENT:
         found = run_client(&task, &config);
         break;
+    case M_RELAY:
+        found = run_relay(&task, &config);
+        break;
+    case M_TABLE:
+        found = table_lookup(&task, &config);
+        break;
+    case M_STDOUT:
+        found = run_stdout(&task, &config);
+        break;
+    case M_SIMULATE:
+        found = run_simulation(&task, &config);
+        break;
+    default:
+        found = false;
+        break;
+    }
+
+    if (config.trace_path != NULL)
+        trace_dump(config.trace_path);
+    if (perf_enabled)
+        perf_report();
+
+    if (found && config.potfile_path != NULL && own_hash)
+        potfile_append(config.potfile_path, config.hash, task.password);
+
+    // The server reports every job of a job file on its own, and the
+    // candidate stream and simulation report must not end with a result
+    if (config.jobs_path == NULL && config.run_mode != M_STDOUT
+        && config.run_mode != M_SIMULATE)
+    {
+        if (found)
+            printf("Password found: '%s'\n", task.password);
+        else
+            printf("Password not found\n");
     }
 
-    if (found)
-        printf("Password found: '%s'\n", task.password);
-    else
-        printf("Password not found\n");
+    if (config.wordlist != NULL)
+        wordlist_close(config.wordlist);
+    if (config.rules != NULL)
+        rules_free(config.rules);
+    if (config.markov != NULL)
+        markov_free(config.markov);
 
     return 0;
 }
@@ -0,0 +1,446 @@
+#include "markov.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+#define MK_MAGIC "BRMK"
+#define MK_VERSION 1
+// Additive smoothing for transitions absent from the corpus
+#define MK_SMOOTHING 0.1
+
+struct mk_header_t
+{
+    char magic[4];
+    unsigned char version, positions, scale, charset;
+};
+
+static int
+mk_cost(double p)
+{
+    int cost = (int) lround(-log2(p) * MK_SCALE);
+    return (cost > MK_MAX_COST) ? MK_MAX_COST : cost;
+}
+
+static bool
+mk_char(char c, int *idx)
+{
+    *idx = (unsigned char) c - MK_FIRST_CHAR;
+    return *idx >= 0 && *idx < MK_CHARSET;
+}
+
+void
+markov_train(const char *corpus, const char *model)
+{
+    static unsigned counts[MK_POSITIONS][MK_CHARSET + 1][MK_CHARSET];
+    static unsigned char costs[MK_POSITIONS][MK_CHARSET + 1][MK_CHARSET];
+
+    FILE *in = fopen(corpus, "r");
+    if (in == NULL)
+        handle_error("fopen");
+
+    char line[256];
+    long words = 0;
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        int prev = 0, idx;
+        for (int pos = 0; pos < MK_POSITIONS && line[pos] != '\0'; ++pos)
+        {
+            if (!mk_char(line[pos], &idx)) break;
+            ++counts[pos][prev][idx];
+            prev = idx + 1;
+        }
+        ++words;
+    }
+    fclose(in);
+
+    for (int pos = 0; pos < MK_POSITIONS; ++pos)
+    {
+        for (int prev = 0; prev <= MK_CHARSET; ++prev)
+        {
+            double total = MK_SMOOTHING * MK_CHARSET;
+            for (int c = 0; c < MK_CHARSET; ++c)
+                total += counts[pos][prev][c];
+            for (int c = 0; c < MK_CHARSET; ++c)
+                costs[pos][prev][c] =
+                    mk_cost((counts[pos][prev][c] + MK_SMOOTHING) / total);
+        }
+    }
+
+    FILE *out = fopen(model, "wb");
+    if (out == NULL)
+        handle_error("fopen");
+    struct mk_header_t header = {
+        .magic = MK_MAGIC,
+        .version = MK_VERSION,
+        .positions = MK_POSITIONS,
+        .scale = MK_SCALE,
+        .charset = MK_CHARSET,
+    };
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(costs, sizeof(costs), 1, out) != 1)
+        handle_error("fwrite");
+    fclose(out);
+
+    fprintf(stderr, "Trained Markov model on %ld words\n", words);
+}
+
+struct markov_t *
+markov_load(const char *model, struct config_t *config)
+{
+    static unsigned char costs[MK_POSITIONS][MK_CHARSET + 1][MK_CHARSET];
+
+    FILE *in = fopen(model, "rb");
+    if (in == NULL)
+        handle_error("fopen");
+    struct mk_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1
+        || memcmp(header.magic, MK_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MK_VERSION
+        || header.positions != MK_POSITIONS
+        || header.scale != MK_SCALE
+        || header.charset != MK_CHARSET
+        || fread(costs, sizeof(costs), 1, in) != 1)
+    {
+        fprintf(stderr, "%s: not a Markov model\n", model);
+        exit(EXIT_FAILURE);
+    }
+    fclose(in);
+
+    struct markov_t *markov = malloc(sizeof(struct markov_t));
+    if (markov == NULL)
+        handle_error("Couldn't allocate space for markov_t");
+
+    int k = strlen(config->alphabet);
+    int charset[MK_CHARSET];
+    if (k > MK_CHARSET || config->length > MK_POSITIONS)
+    {
+        fprintf(stderr, "Markov mode supports up to %d printable characters "
+                        "and length %d\n", MK_CHARSET, MK_POSITIONS);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < k; ++i)
+    {
+        if (!mk_char(config->alphabet[i], &charset[i]))
+        {
+            fprintf(stderr, "Markov mode supports printable ASCII only\n");
+            exit(EXIT_FAILURE);
+        }
+        markov->alphabet[i] = config->alphabet[i];
+    }
+    markov->alph_size = k;
+    markov->length = config->length;
+
+    for (int pos = 0; pos < markov->length; ++pos)
+    {
+        for (int prev = 0; prev <= k; ++prev)
+        {
+            // Transitions leaving the alphabet don't exist in our keyspace
+            int from = (prev == 0) ? 0 : charset[prev - 1] + 1;
+            double total = 0;
+            for (int c = 0; c < k; ++c)
+                total += exp2(-costs[pos][from][charset[c]] / (double) MK_SCALE);
+            for (int c = 0; c < k; ++c)
+            {
+                double p = exp2(-costs[pos][from][charset[c]] / (double) MK_SCALE);
+                markov->cost[pos][prev][c] = mk_cost(p / total);
+                markov->order[pos][prev][c] = c;
+            }
+
+            // Insertion sort, the alphabet is small
+            unsigned char *order = markov->order[pos][prev];
+            unsigned char *cost = markov->cost[pos][prev];
+            for (int i = 1; i < k; ++i)
+            {
+                unsigned char c = order[i];
+                int j = i;
+                for (; j > 0 && cost[order[j - 1]] > cost[c]; --j)
+                    order[j] = order[j - 1];
+                order[j] = c;
+            }
+        }
+    }
+
+    markov->min_rest[markov->length] = markov->max_rest[markov->length] = 0;
+    for (int pos = markov->length - 1; pos >= 0; --pos)
+    {
+        int lo = MK_MAX_COST, hi = 0;
+        for (int prev = 0; prev <= k; ++prev)
+        {
+            unsigned char *order = markov->order[pos][prev];
+            unsigned char *cost = markov->cost[pos][prev];
+            if (cost[order[0]] < lo) lo = cost[order[0]];
+            if (cost[order[k - 1]] > hi) hi = cost[order[k - 1]];
+        }
+        markov->min_rest[pos] = markov->min_rest[pos + 1] + lo;
+        markov->max_rest[pos] = markov->max_rest[pos + 1] + hi;
+    }
+
+    markov->level = config->markov_level;
+    if (markov->level < 0 || markov->level > markov->max_rest[0])
+        markov->level = markov->max_rest[0];
+
+    return markov;
+}
+
+void
+markov_free(struct markov_t *markov)
+{
+    free(markov);
+}
+
+// Task ids enumerate (cost band, first character) pairs, most likely first
+long long
+markov_tasks(struct markov_t *markov)
+{
+    return (long long) (markov->level + 1) * markov->alph_size;
+}
+
+void
+markov_report(struct markov_t *markov)
+{
+    int k = markov->alph_size;
+    int width = markov->max_rest[0] + 1;
+    double *mass = calloc(2 * (size_t) (k + 1) * width, sizeof(double));
+    double *count = calloc(2 * (size_t) (k + 1) * width, sizeof(double));
+    if (mass == NULL || count == NULL)
+        handle_error("Couldn't allocate space for markov_report");
+
+    // Probability mass and number of candidates per (last char, cost)
+    double *cur_mass = mass, *next_mass = mass + (k + 1) * width;
+    double *cur_count = count, *next_count = count + (k + 1) * width;
+    cur_mass[0] = 1;
+    cur_count[0] = 1;
+    for (int pos = 0; pos < markov->length; ++pos)
+    {
+        memset(next_mass, 0, (k + 1) * width * sizeof(double));
+        memset(next_count, 0, (k + 1) * width * sizeof(double));
+        for (int prev = 0; prev <= k; ++prev)
+        {
+            for (int acc = 0; acc < width; ++acc)
+            {
+                double m = cur_mass[prev * width + acc];
+                double n = cur_count[prev * width + acc];
+                if (n == 0) continue;
+                for (int c = 0; c < k; ++c)
+                {
+                    int cost = acc + markov->cost[pos][prev][c];
+                    if (cost >= width) continue;
+                    double p = exp2(-markov->cost[pos][prev][c] / (double) MK_SCALE);
+                    next_mass[(c + 1) * width + cost] += m * p;
+                    next_count[(c + 1) * width + cost] += n;
+                }
+            }
+        }
+        double *tmp = cur_mass; cur_mass = next_mass; next_mass = tmp;
+        tmp = cur_count; cur_count = next_count; next_count = tmp;
+    }
+
+    double covered = 0, total = 0, candidates = 0;
+    for (int prev = 0; prev <= k; ++prev)
+    {
+        for (int acc = 0; acc < width; ++acc)
+        {
+            total += cur_mass[prev * width + acc];
+            if (acc <= markov->level)
+            {
+                covered += cur_mass[prev * width + acc];
+                candidates += cur_count[prev * width + acc];
+            }
+        }
+    }
+    fprintf(stderr, "Markov level %d: %.0f candidates, expected coverage %.2f%%\n",
+            markov->level, candidates, (total > 0) ? 100 * covered / total : 0);
+
+    free(mass);
+    free(count);
+}
+
+// Candidates in a task id, rest holds the number of ways to finish a
+// candidate from the second position by previous character and cost
+static double
+mk_weight(struct markov_t *markov, const double *rest, int width, long long id)
+{
+    if (markov->length == 0)
+        return id == 0;
+    int first = id % markov->alph_size;
+    int acc = id / markov->alph_size - markov->cost[0][0][first];
+    return (acc < 0) ? 0 : rest[(first + 1) * width + acc];
+}
+
+static long long
+mk_boundary(const double *weights, long long tasks, double total,
+            int shard, int shard_count)
+{
+    if (shard == shard_count)
+        return tasks;
+    double target = total * shard / shard_count, seen = 0;
+    long long id = 0;
+    for (; id < tasks && seen < target; ++id)
+        seen += weights[id];
+    return id;
+}
+
+// Bands hold very different numbers of candidates, so shards get
+// contiguous runs of task ids weighted by their candidate counts
+void
+markov_shard(struct markov_t *markov, struct task_t *task, struct config_t *config)
+{
+    int k = markov->alph_size;
+    int width = markov->level + 1;
+    long long tasks = task->end;
+    double *rest = calloc(2 * (size_t) (k + 1) * width, sizeof(double));
+    double *weights = malloc(tasks * sizeof(double));
+    if (rest == NULL || weights == NULL)
+        handle_error("Couldn't allocate space for markov_shard");
+
+    double *cur = rest, *next = rest + (k + 1) * width;
+    for (int prev = 0; prev <= k; ++prev)
+        cur[prev * width] = 1;
+    for (int pos = markov->length - 1; pos >= 1; --pos)
+    {
+        memset(next, 0, (k + 1) * width * sizeof(double));
+        for (int prev = 0; prev <= k; ++prev)
+        {
+            for (int c = 0; c < k; ++c)
+            {
+                int cost = markov->cost[pos][prev][c];
+                for (int acc = cost; acc < width; ++acc)
+                    next[prev * width + acc] += cur[(c + 1) * width + acc - cost];
+            }
+        }
+        double *tmp = cur; cur = next; next = tmp;
+    }
+
+    double total = 0;
+    for (long long id = 0; id < tasks; ++id)
+        total += weights[id] = mk_weight(markov, cur, width, id);
+    task->offset = mk_boundary(weights, tasks, total,
+                               config->shard_index, config->shard_count);
+    task->end = mk_boundary(weights, tasks, total,
+                            config->shard_index + 1, config->shard_count);
+
+    free(rest);
+    free(weights);
+}
+
+void
+mk_init(struct mk_state_t *state, struct task_t *task, struct config_t *config)
+{
+    state->task = task;
+    state->end = task->end;
+    task->end = task->offset + 1;
+}
+
+bool
+mk_next(struct mk_state_t *state)
+{
+    struct task_t *task = state->task;
+    if (task->end >= state->end) return false;
+    task->offset = task->end;
+    task->end = task->offset + 1;
+    return true;
+}
+
+static bool
+mk_split(struct task_t *task,
+         struct config_t *config,
+         void *context,
+         password_handler_t handler)
+{
+    struct mk_state_t state;
+    long long offset = task->offset;
+    mk_init(&state, task, config);
+    bool found = false;
+    while (!found)
+    {
+        found = handler(context, task);
+        if (!mk_next(&state))
+            break;
+    }
+    task->offset = offset;
+    task->end = state.end;
+    return found;
+}
+
+struct mk_search_t
+{
+    struct markov_t *markov;
+    struct task_t *task;
+    void *context;
+    password_handler_t handler;
+    int lo, hi;
+};
+
+// Depth-first search over candidates with total cost in [lo, hi)
+static bool
+mk_search(struct mk_search_t *search, int pos, int prev, int acc)
+{
+    struct markov_t *markov = search->markov;
+    if (pos == markov->length)
+        return search->handler(search->context, search->task);
+
+    unsigned char *order = markov->order[pos][prev];
+    unsigned char *cost = markov->cost[pos][prev];
+    for (int i = 0; i < markov->alph_size; ++i)
+    {
+        int c = order[i];
+        int total = acc + cost[c];
+        if (total + markov->min_rest[pos + 1] >= search->hi) break;
+        if (total + markov->max_rest[pos + 1] < search->lo) continue;
+        search->task->password[pos] = markov->alphabet[c];
+        if (mk_search(search, pos + 1, c + 1, total))
+            return true;
+    }
+    return false;
+}
+
+static bool
+mk_candidates(struct task_t *task,
+              struct config_t *config,
+              void *context,
+              password_handler_t handler)
+{
+    struct markov_t *markov = config->markov;
+    struct mk_search_t search = {
+        .markov = markov,
+        .task = task,
+        .context = context,
+        .handler = handler,
+    };
+    if (markov->length == 0)
+        return task->offset == 0 && handler(context, task);
+
+    for (long long id = task->offset; id < task->end; ++id)
+    {
+        int first = id % markov->alph_size;
+        search.lo = id / markov->alph_size;
+        search.hi = search.lo + 1;
+
+        int acc = markov->cost[0][0][first];
+        if (acc + markov->min_rest[1] >= search.hi
+            || acc + markov->max_rest[1] < search.lo)
+            continue;
+        task->password[0] = markov->alphabet[first];
+        if (mk_search(&search, 1, first + 1, acc))
+            return true;
+    }
+    return false;
+}
+
+bool
+bruteforce_markov(struct task_t *task,
+                  struct config_t *config,
+                  void *context,
+                  password_handler_t handler)
+{
+    if (task->from != 0)
+        return mk_split(task, config, context, handler);
+    return mk_candidates(task, config, context, handler);
+}
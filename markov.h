@@ -0,0 +1,64 @@
+#ifndef MARKOV_H
+#define MARKOV_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+// Printable ASCII, index 0 of the previous character means "no previous"
+#define MK_FIRST_CHAR ' '
+#define MK_CHARSET ('~' - ' ' + 1)
+#define MK_POSITIONS (PASSWORD_SIZE - 1)
+// Costs are -log2(p) in units of 1 / MK_SCALE bits
+#define MK_SCALE 4
+#define MK_MAX_COST 255
+
+struct markov_t
+{
+    int alph_size;
+    int length;
+    int level;
+    char alphabet[MK_CHARSET];
+    // Costs renormalized over the configured alphabet
+    unsigned char cost[MK_POSITIONS][MK_CHARSET + 1][MK_CHARSET];
+    // Alphabet indices sorted by ascending cost
+    unsigned char order[MK_POSITIONS][MK_CHARSET + 1][MK_CHARSET];
+    int min_rest[MK_POSITIONS + 1], max_rest[MK_POSITIONS + 1];
+};
+
+struct mk_state_t
+{
+    struct task_t *task;
+    long long end;
+};
+
+void
+markov_train(const char *corpus, const char *model);
+
+struct markov_t *
+markov_load(const char *model, struct config_t *);
+
+void
+markov_free(struct markov_t *);
+
+long long
+markov_tasks(struct markov_t *);
+
+void
+markov_report(struct markov_t *);
+
+// Restricts the task covering all task ids to this shard's slice
+void
+markov_shard(struct markov_t *, struct task_t *, struct config_t *);
+
+void
+mk_init(struct mk_state_t *, struct task_t *, struct config_t *);
+
+bool
+mk_next(struct mk_state_t *);
+
+bool
+bruteforce_markov(struct task_t *, struct config_t *, void *context,
+                  password_handler_t);
+
+#endif // MARKOV_H
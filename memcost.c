@@ -0,0 +1,142 @@
+#include "memcost.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static const char itoa64[] =
+    "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+static int
+atoi64(char c)
+{
+    const char *p = c != '\0' ? strchr(itoa64, c) : NULL;
+    return p != NULL ? p - itoa64 : -1;
+}
+
+// yescrypt's variable-length integers: values up to 47 take one character,
+// larger ones a prefix character followed by 6 bits per extra character
+static const char *
+decode64_uint32(uint32_t *dst, const char *src, uint32_t min)
+{
+    uint32_t start = 0, end = 47, chars = 1, bits = 0;
+    int c = atoi64(*src++);
+    if (c < 0)
+        return NULL;
+
+    *dst = min;
+    while ((uint32_t) c > end)
+    {
+        *dst += (end + 1 - start) << bits;
+        start = end + 1;
+        end = start + (62 - end) / 2;
+        ++chars;
+        bits += 6;
+    }
+    *dst += (c - start) << bits;
+
+    while (--chars)
+    {
+        c = atoi64(*src++);
+        if (c < 0)
+            return NULL;
+        bits -= 6;
+        *dst += (uint32_t) c << bits;
+    }
+    return src;
+}
+
+// scrypt's fixed 30-bit little-endian integers
+static const char *
+decode64_fixed(uint32_t *dst, const char *src)
+{
+    *dst = 0;
+    for (int bits = 0; bits < 30; bits += 6)
+    {
+        int c = atoi64(*src++);
+        if (c < 0)
+            return NULL;
+        *dst |= (uint32_t) c << bits;
+    }
+    return src;
+}
+
+bool
+memcost_parse(const char *hash, struct memcost_t *cost)
+{
+    uint32_t flavor, n_log2, r;
+
+    // $y$ and $gy$ share the yescrypt parameter encoding: flavor, log2(N)
+    // and r, optionally followed by p and friends which we don't need
+    const char *params = NULL;
+    if (strncmp(hash, "$y$", 3) == 0)
+    {
+        cost->scheme = "yescrypt";
+        params = hash + 3;
+    }
+    else if (strncmp(hash, "$gy$", 4) == 0)
+    {
+        cost->scheme = "gost-yescrypt";
+        params = hash + 4;
+    }
+    if (params != NULL)
+    {
+        if ((params = decode64_uint32(&flavor, params, 0)) == NULL
+            || (params = decode64_uint32(&n_log2, params, 1)) == NULL
+            || (params = decode64_uint32(&r, params, 1)) == NULL
+            || n_log2 > 40)
+            return false;
+        cost->bytes = (size_t) 128 * r << n_log2;
+        return true;
+    }
+
+    // $7$ has log2(N) in one character, then r and p in five each
+    if (strncmp(hash, "$7$", 3) == 0)
+    {
+        cost->scheme = "scrypt";
+        int c = atoi64(hash[3]);
+        if (c < 0 || c > 40 || decode64_fixed(&r, hash + 4) == NULL)
+            return false;
+        cost->bytes = (size_t) 128 * r << c;
+        return true;
+    }
+
+    return false;
+}
+
+static size_t
+memcost_budget(struct config_t *config)
+{
+    if (config->mem_budget > 0)
+        return (size_t) config->mem_budget << 20;
+    return (size_t) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+}
+
+// Only the budget bounds the workers, so a costlier hash never gets more
+// of them than a cheaper one
+int
+memcost_limit(struct config_t *config, int threads)
+{
+    struct memcost_t cost;
+    if (config->hash == NULL || !memcost_parse(config->hash, &cost)
+        || cost.bytes == 0)
+        return threads;
+
+    long long limit = memcost_budget(config) / cost.bytes;
+    if (limit < 1)
+        limit = 1;
+    return (limit < threads) ? limit : threads;
+}
+
+int
+memcost_threads(struct config_t *config, int threads)
+{
+    int limit = memcost_limit(config, threads);
+    struct memcost_t cost;
+    if (limit < threads && memcost_parse(config->hash, &cost))
+        fprintf(stderr, "%s needs %zu KiB per hash, limiting to %d of %d threads"
+                " (budget %zu MiB)\n", cost.scheme, cost.bytes >> 10, limit,
+                threads, memcost_budget(config) >> 20);
+    return limit;
+}
@@ -0,0 +1,29 @@
+#ifndef MEMCOST_H
+#define MEMCOST_H
+
+#include "common.h"
+
+#include <stddef.h>
+
+// Working set of one evaluation of a memory-hard hash and the name of its
+// scheme, parsed from the cost parameters of the setting
+struct memcost_t
+{
+    const char *scheme;
+    size_t bytes;
+};
+
+// false for hashes that only need a few kilobytes (DES, MD5, SHA-crypt)
+bool
+memcost_parse(const char *hash, struct memcost_t *);
+
+// Caps threads to the workers whose working sets fit in config->mem_budget,
+// half of the available memory by default
+int
+memcost_limit(struct config_t *, int threads);
+
+// memcost_limit, reporting the cap on stderr
+int
+memcost_threads(struct config_t *, int threads);
+
+#endif // MEMCOST_H
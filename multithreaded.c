@@ -4,34 +4,53 @@
 #include "iterative.h"
 #include "recursive.h"
 #include "queue.h"
+#include "trace.h"
+#include "latch.h"
+#include "arena.h"
+#include "memcost.h"
 
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
 
 struct mt_context_t
 {
-    volatile int tasks_running;
-    pthread_mutex_t tasks_mutex;
-    pthread_cond_t tasks_cond;
-
     struct queue_t queue;
-    password_t password;
-    char *hash;
+    // Tasks handed out, only the splitting thread touches it
+    long long tasks_sent;
+    struct latch_t latch;
+    struct arena_t crypt_arena;
+
+    password_t password CACHE_ALIGNED;
     volatile bool found;
 
+    char *hash CACHE_ALIGNED;
     struct config_t *config;
 };
 
+struct mt_worker_t
+{
+    struct mt_context_t *context;
+    int index;
+};
+
 static void *
 mt_worker(void *arg)
 {
-    struct mt_context_t *context = (struct mt_context_t *) arg;
+    struct mt_worker_t *worker = (struct mt_worker_t *) arg;
+    struct mt_context_t *context = worker->context;
     struct config_t *config = context->config;
 
     struct st_context_t st_context;
     st_context.hash = context->hash;
-    st_context.cd.initialized = 0;
+    st_context.cd = arena_slot(&context->crypt_arena, worker->index);
+    st_context.stop = NULL;
+    trace_thread("mt_worker");
 
     while (true)
     {
@@ -40,18 +59,15 @@ mt_worker(void *arg)
 
         task.to = task.from;
         task.from = 0;
+        uint64_t start = trace_begin();
         if (process_task(&task, config, &st_context, st_password_handler))
         {
             memcpy(context->password, task.password, sizeof(task.password));
             context->found = true;
         }
+        trace_end("task", H_TASK, start);
 
-        pthread_mutex_lock(&context->tasks_mutex);
-        --context->tasks_running;
-        pthread_mutex_unlock(&context->tasks_mutex);
-
-        if (context->tasks_running == 0)
-            pthread_cond_signal(&context->tasks_cond);
+        latch_arrive(&context->latch, worker->index);
     }
     return NULL;
 }
@@ -61,12 +77,9 @@ mt_password_handler(void *context, struct task_t *task)
 {
     struct mt_context_t *ctx = (struct mt_context_t *) context;
 
-    pthread_mutex_lock(&ctx->tasks_mutex);
-    ++ctx->tasks_running;
-    pthread_mutex_unlock(&ctx->tasks_mutex);
-
+    ++ctx->tasks_sent;
     queue_push(&ctx->queue, task);
-    return (ctx->password[0] != 0);
+    return ctx->found;
 }
 
 bool
@@ -74,31 +87,31 @@ multithreaded(struct task_t *task, struct config_t *config)
 {
     struct mt_context_t context;
     context.hash = config->hash;
-    context.tasks_running = 0;
-    pthread_mutex_init(&context.tasks_mutex, NULL);
-    pthread_cond_init(&context.tasks_cond, NULL);
+    context.tasks_sent = 0;
     context.password[0] = 0;
+    context.found = false;
     context.config = config;
 
     queue_init(&context.queue);
 
-    int cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int cpu_count = memcost_threads(config, thread_count(config));
+    latch_init(&context.latch, cpu_count);
+    if (arena_init(&context.crypt_arena, sizeof(struct crypt_data), cpu_count) == -1)
+        handle_error("mmap");
     pthread_t threads[cpu_count];
+    struct mt_worker_t workers[cpu_count];
     for (int i = 0; i < cpu_count; ++i)
     {
-        pthread_create(&threads[i], NULL, mt_worker, (void *) &context);
+        workers[i] = (struct mt_worker_t) { &context, i };
+        pthread_create(&threads[i], NULL, mt_worker, (void *) &workers[i]);
     }
 
-    task->from = 2;
-    if (config->length < 3) task->from = 1;
+    task->from = split_point(config);
     task->to = config->length;
 
-    process_task(task, config, &context, mt_password_handler);
+    split_task(task, config, &context, mt_password_handler);
 
-    pthread_mutex_lock(&context.tasks_mutex);
-    while (context.tasks_running != 0)
-        pthread_cond_wait(&context.tasks_cond, &context.tasks_mutex);
-    pthread_mutex_unlock(&context.tasks_mutex);
+    latch_wait(&context.latch, context.tasks_sent, NULL);
 
     for (int i = 0; i < cpu_count; ++i)
     {
@@ -109,8 +122,8 @@ multithreaded(struct task_t *task, struct config_t *config)
     memcpy(task->password, context.password, sizeof(context.password));
 
     queue_destroy(&context.queue);
-    pthread_mutex_destroy(&context.tasks_mutex);
-    pthread_cond_destroy(&context.tasks_cond);
+    latch_destroy(&context.latch);
+    arena_destroy(&context.crypt_arena);
 
     return context.found;
 }
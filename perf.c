@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include "perf.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+bool perf_enabled = false;
+
+static struct perf_thread_t *threads = NULL;
+static __thread struct perf_thread_t *local = NULL;
+
+static const char *mode_names[] = {
+    [M_RECURSIVE] = "recursive",
+    [M_ITERATIVE] = "iterative",
+    [M_REC_ITERATOR] = "rec-iterator",
+    [M_WORDLIST] = "wordlist",
+    [M_MARKOV] = "markov",
+    [M_HYBRID] = "hybrid",
+    [M_HYBRID_PREFIX] = "hybrid-prefix",
+};
+
+#ifdef __linux__
+
+static int
+perf_open(uint32_t type, uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void
+perf_open_group(struct perf_thread_t *thread)
+{
+    static const struct { uint32_t type; uint64_t config; } events[PC_COUNT] = {
+        [PC_TASK_CLOCK] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+        [PC_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        [PC_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        [PC_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        [PC_L1D_MISSES] = { PERF_TYPE_HW_CACHE,
+                            PERF_COUNT_HW_CACHE_L1D
+                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        [PC_LLC_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        [PC_CONTEXT_SWITCHES] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    };
+
+    // The software task clock leads, so the group works without a PMU
+    thread->leader = perf_open(events[0].type, events[0].config, -1);
+    thread->nr = 0;
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        thread->slot[i] = -1;
+        if (thread->leader == -1)
+            continue;
+        int fd = (i == 0) ? thread->leader
+                          : perf_open(events[i].type, events[i].config, thread->leader);
+        if (fd != -1)
+            thread->slot[i] = thread->nr++;
+    }
+}
+
+static bool
+perf_read(struct perf_thread_t *thread, uint64_t *values)
+{
+    uint64_t buffer[PC_COUNT + 1];
+    ssize_t size = (thread->nr + 1) * sizeof(uint64_t);
+    if (read(thread->leader, buffer, size) != size)
+        return false;
+    for (int i = 0; i < PC_COUNT; ++i)
+        values[i] = (thread->slot[i] != -1) ? buffer[thread->slot[i] + 1] : 0;
+    return true;
+}
+
+#else
+
+static void
+perf_open_group(struct perf_thread_t *thread)
+{
+    thread->leader = -1;
+}
+
+static bool
+perf_read(struct perf_thread_t *thread, uint64_t *values)
+{
+    return false;
+}
+
+#endif
+
+static struct perf_thread_t *
+perf_thread(void)
+{
+    if (local != NULL)
+        return local;
+
+    local = calloc(1, sizeof(struct perf_thread_t));
+    if (local == NULL)
+        handle_error("Couldn't allocate space for perf_thread_t");
+    perf_open_group(local);
+    if (local->leader == -1)
+    {
+        static bool warned = false;
+        if (!__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED))
+            perror("perf_event_open");
+    }
+
+    struct perf_thread_t *head = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    do
+    {
+        local->next = head;
+    } while (!__atomic_compare_exchange_n(&threads, &head, local, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return local;
+}
+
+void
+perf_begin(struct perf_sample_t *sample)
+{
+    sample->valid = false;
+    if (!perf_enabled)
+        return;
+    struct perf_thread_t *thread = perf_thread();
+    sample->valid = (thread->leader != -1) && perf_read(thread, sample->values);
+}
+
+void
+perf_end(struct perf_sample_t *sample,
+         enum brute_mode_t mode,
+         const char *handler,
+         uint64_t candidates)
+{
+    if (!sample->valid)
+        return;
+    struct perf_thread_t *thread = local;
+    uint64_t values[PC_COUNT];
+    if (!perf_read(thread, values))
+        return;
+
+    struct perf_stat_t *stat = NULL;
+    for (int i = 0; i < thread->nstats && stat == NULL; ++i)
+        if (thread->stats[i].mode == mode && thread->stats[i].handler == handler)
+            stat = &thread->stats[i];
+    if (stat == NULL)
+    {
+        if (thread->nstats == PERF_MAX_STATS)
+            return;
+        stat = &thread->stats[thread->nstats++];
+        stat->mode = mode;
+        stat->handler = handler;
+    }
+
+    ++stat->tasks;
+    stat->candidates += candidates;
+    for (int i = 0; i < PC_COUNT; ++i)
+        stat->values[i] += values[i] - sample->values[i];
+}
+
+static void
+perf_column(uint64_t value, uint64_t divisor, bool available)
+{
+    if (available && divisor != 0)
+        fprintf(stderr, " %12.2f", (double) value / divisor);
+    else
+        fprintf(stderr, " %12s", "n/a");
+}
+
+// Per (brute mode, handler) totals over all threads, printed to stderr
+void
+perf_report(void)
+{
+    struct perf_stat_t totals[PERF_MAX_STATS * 4];
+    bool available[PC_COUNT] = { false };
+    int count = 0;
+
+    struct perf_thread_t *thread = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+    for (; thread != NULL; thread = thread->next)
+    {
+        for (int c = 0; c < PC_COUNT; ++c)
+            available[c] |= (thread->slot[c] != -1);
+        for (int i = 0; i < thread->nstats; ++i)
+        {
+            struct perf_stat_t *stat = &thread->stats[i], *total = NULL;
+            for (int j = 0; j < count && total == NULL; ++j)
+                if (totals[j].mode == stat->mode && totals[j].handler == stat->handler)
+                    total = &totals[j];
+            if (total == NULL)
+            {
+                if (count == sizeof(totals) / sizeof(totals[0]))
+                    continue;
+                total = &totals[count++];
+                memset(total, 0, sizeof(*total));
+                total->mode = stat->mode;
+                total->handler = stat->handler;
+            }
+            total->tasks += stat->tasks;
+            total->candidates += stat->candidates;
+            for (int c = 0; c < PC_COUNT; ++c)
+                total->values[c] += stat->values[c];
+        }
+    }
+
+    fprintf(stderr, "%-12s %-12s %12s %12s %12s %12s %12s %12s %12s %12s\n",
+            "mode", "handler", "candidates", "ns/cand", "cycles/cand", "IPC",
+            "brmiss/cand", "L1Dmiss/cand", "LLCmiss/cand", "ctxsw/task");
+    for (int i = 0; i < count; ++i)
+    {
+        struct perf_stat_t *total = &totals[i];
+        fprintf(stderr, "%-12s %-12s %12llu", mode_names[total->mode],
+                total->handler, (unsigned long long) total->candidates);
+        perf_column(total->values[PC_TASK_CLOCK], total->candidates,
+                    available[PC_TASK_CLOCK]);
+        perf_column(total->values[PC_CYCLES], total->candidates,
+                    available[PC_CYCLES]);
+        perf_column(total->values[PC_INSTRUCTIONS], total->values[PC_CYCLES],
+                    available[PC_INSTRUCTIONS] && available[PC_CYCLES]);
+        perf_column(total->values[PC_BRANCH_MISSES], total->candidates,
+                    available[PC_BRANCH_MISSES]);
+        perf_column(total->values[PC_L1D_MISSES], total->candidates,
+                    available[PC_L1D_MISSES]);
+        perf_column(total->values[PC_LLC_MISSES], total->candidates,
+                    available[PC_LLC_MISSES]);
+        perf_column(total->values[PC_CONTEXT_SWITCHES], total->tasks,
+                    available[PC_CONTEXT_SWITCHES]);
+        fprintf(stderr, "\n");
+    }
+}
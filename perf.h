@@ -0,0 +1,62 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Distinct (brute mode, handler) pairs recorded per thread
+#define PERF_MAX_STATS 8
+
+enum perf_counter_t
+{
+    PC_TASK_CLOCK,
+    PC_CYCLES,
+    PC_INSTRUCTIONS,
+    PC_BRANCH_MISSES,
+    PC_L1D_MISSES,
+    PC_LLC_MISSES,
+    PC_CONTEXT_SWITCHES,
+    PC_COUNT,
+};
+
+struct perf_sample_t
+{
+    bool valid;
+    uint64_t values[PC_COUNT];
+};
+
+struct perf_stat_t
+{
+    enum brute_mode_t mode;
+    const char *handler;
+    uint64_t tasks, candidates;
+    uint64_t values[PC_COUNT];
+};
+
+// Counter group of one thread, published through a lock-free list
+struct perf_thread_t
+{
+    int leader;
+    // Position of each counter in the group read, -1 if unsupported
+    int slot[PC_COUNT];
+    int nr;
+    struct perf_stat_t stats[PERF_MAX_STATS];
+    int nstats;
+    struct perf_thread_t *next;
+};
+
+extern bool perf_enabled;
+
+void
+perf_begin(struct perf_sample_t *);
+
+void
+perf_end(struct perf_sample_t *, enum brute_mode_t, const char *handler,
+         uint64_t candidates);
+
+void
+perf_report(void);
+
+#endif // PERF_H
@@ -0,0 +1,129 @@
+#include "potfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+static uint64_t
+pot_hash(const char *str)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *str != '\0'; ++str)
+    {
+        hash ^= (unsigned char) *str;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void
+pot_insert(struct potfile_t *pot, const char *hash, const char *password)
+{
+    size_t i = pot_hash(hash) & (pot->capacity - 1);
+    while (pot->slots[i].hash != NULL && strcmp(pot->slots[i].hash, hash) != 0)
+        i = (i + 1) & (pot->capacity - 1);
+    if (pot->slots[i].hash == NULL)
+        ++pot->count;
+    pot->slots[i].hash = hash;
+    pot->slots[i].password = password;
+}
+
+struct potfile_t *
+potfile_load(const char *path)
+{
+    struct potfile_t *pot = calloc(1, sizeof(struct potfile_t));
+    if (pot == NULL)
+        handle_error("Couldn't allocate space for potfile_t");
+
+    size_t size = 0;
+    FILE *file = fopen(path, "r");
+    if (file != NULL)
+    {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+    }
+    else if (errno != ENOENT)
+    {
+        handle_error("fopen");
+    }
+
+    pot->data = malloc(size + 1);
+    if (pot->data == NULL)
+        handle_error("Couldn't allocate space for potfile");
+    if (file != NULL)
+    {
+        size = fread(pot->data, 1, size, file);
+        fclose(file);
+    }
+    pot->data[size] = '\0';
+
+    size_t lines = 0;
+    for (size_t i = 0; i < size; ++i)
+        lines += (pot->data[i] == '\n');
+
+    pot->capacity = 16;
+    while (pot->capacity < 2 * (lines + 1))
+        pot->capacity *= 2;
+    pot->slots = calloc(pot->capacity, sizeof(struct pot_entry_t));
+    if (pot->slots == NULL)
+        handle_error("Couldn't allocate space for potfile index");
+
+    // Lines are "hash:password", crypt(3) hashes never contain ':'
+    char *line = pot->data;
+    while (*line != '\0')
+    {
+        char *end = strchr(line, '\n');
+        if (end == NULL) break; // Incomplete line from an interrupted write
+        *end = '\0';
+        char *sep = strchr(line, ':');
+        if (sep != NULL)
+        {
+            *sep = '\0';
+            pot_insert(pot, line, sep + 1);
+        }
+        line = end + 1;
+    }
+
+    return pot;
+}
+
+void
+potfile_free(struct potfile_t *pot)
+{
+    free(pot->slots);
+    free(pot->data);
+    free(pot);
+}
+
+const char *
+potfile_find(struct potfile_t *pot, const char *hash)
+{
+    size_t i = pot_hash(hash) & (pot->capacity - 1);
+    while (pot->slots[i].hash != NULL)
+    {
+        if (strcmp(pot->slots[i].hash, hash) == 0)
+            return pot->slots[i].password;
+        i = (i + 1) & (pot->capacity - 1);
+    }
+    return NULL;
+}
+
+void
+potfile_append(const char *path, const char *hash, const char *password)
+{
+    FILE *file = fopen(path, "a");
+    if (file == NULL)
+    {
+        perror("fopen");
+        return;
+    }
+    // One buffered write per line keeps concurrent appenders from interleaving
+    fprintf(file, "%s:%s\n", hash, password);
+    fclose(file);
+}
@@ -0,0 +1,32 @@
+#ifndef POTFILE_H
+#define POTFILE_H
+
+#include <stddef.h>
+
+struct pot_entry_t
+{
+    const char *hash;
+    const char *password;
+};
+
+// Open-addressing index over the lines of an append-only potfile
+struct potfile_t
+{
+    char *data;
+    struct pot_entry_t *slots;
+    size_t capacity, count;
+};
+
+struct potfile_t *
+potfile_load(const char *path);
+
+void
+potfile_free(struct potfile_t *);
+
+const char *
+potfile_find(struct potfile_t *, const char *hash);
+
+void
+potfile_append(const char *path, const char *hash, const char *password);
+
+#endif // POTFILE_H
@@ -1,4 +1,5 @@
 #include "queue.h"
+#include "trace.h"
 
 void
 queue_init(struct queue_t *queue)
@@ -26,6 +27,7 @@ queue_destroy(struct queue_t *queue)
 void
 queue_push(struct queue_t *queue, struct task_t *task)
 {
+    uint64_t start = trace_begin();
     sem_wait(&queue->available);
 
     pthread_mutex_lock(&queue->tail_mut);
@@ -37,11 +39,13 @@ queue_push(struct queue_t *queue, struct task_t *task)
     pthread_mutex_unlock(&queue->tail_mut);
   
     sem_post(&queue->count);
+    trace_end("queue_push", H_NONE, start);
 }
 
 void
 queue_pop(struct queue_t *queue, struct task_t *task)
 {
+    uint64_t start = trace_begin();
     sem_wait(&queue->count);
 
     pthread_mutex_lock(&queue->head_mut);
@@ -53,4 +57,5 @@ queue_pop(struct queue_t *queue, struct task_t *task)
     pthread_mutex_unlock(&queue->head_mut);
 
     sem_post(&queue->available);
+    trace_end("queue_pop", H_QUEUE_WAIT, start);
 }
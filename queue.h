@@ -11,13 +11,18 @@
 
 #include <pthread.h>
 
+// Consumers only write the head line and producers the tail line
 struct queue_t
 {
     struct task_t tasks[8];
     int size, capacity;
-    int head, tail;
-    pthread_mutex_t head_mut, tail_mut;
     sem_t count, available;
+
+    int head CACHE_ALIGNED;
+    pthread_mutex_t head_mut;
+
+    int tail CACHE_ALIGNED;
+    pthread_mutex_t tail_mut;
 };
 
 void
@@ -0,0 +1,227 @@
+#include "rules.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+static void
+rules_emit(struct rules_t *rules, size_t *capacity, unsigned char byte)
+{
+    if (rules->size == *capacity)
+    {
+        *capacity *= 2;
+        rules->code = realloc(rules->code, *capacity);
+        if (rules->code == NULL)
+            handle_error("Couldn't reallocate space for rules_t");
+    }
+    rules->code[rules->size++] = byte;
+}
+
+// Compiles one line into bytecode, returns false on syntax errors
+static bool
+rules_compile(struct rules_t *rules, size_t *capacity, const char *line)
+{
+    for (const char *c = line; *c != '\0' && *c != '\n'; ++c)
+    {
+        switch (*c)
+        {
+        case ' ':
+        case '\t':
+        case '\r':
+            break;
+        case ':': rules_emit(rules, capacity, OP_NOOP); break;
+        case 'l': rules_emit(rules, capacity, OP_LOWER); break;
+        case 'u': rules_emit(rules, capacity, OP_UPPER); break;
+        case 'c': rules_emit(rules, capacity, OP_CAPITALIZE); break;
+        case 't': rules_emit(rules, capacity, OP_TOGGLE); break;
+        case 'r': rules_emit(rules, capacity, OP_REVERSE); break;
+        case 'd': rules_emit(rules, capacity, OP_DUPLICATE); break;
+        case '[': rules_emit(rules, capacity, OP_TRUNCATE_FIRST); break;
+        case ']': rules_emit(rules, capacity, OP_TRUNCATE_LAST); break;
+        case '$':
+        case '^':
+            if (c[1] == '\0' || c[1] == '\n') return false;
+            rules_emit(rules, capacity, (*c == '$') ? OP_APPEND : OP_PREPEND);
+            rules_emit(rules, capacity, *++c);
+            break;
+        case 's':
+            if (c[1] == '\0' || c[1] == '\n' || c[2] == '\0' || c[2] == '\n')
+                return false;
+            rules_emit(rules, capacity, OP_SUBSTITUTE);
+            rules_emit(rules, capacity, *++c);
+            rules_emit(rules, capacity, *++c);
+            break;
+        default:
+            return false;
+        }
+    }
+    rules_emit(rules, capacity, OP_END);
+    return true;
+}
+
+struct rules_t *
+rules_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        handle_error("fopen");
+
+    struct rules_t *rules = malloc(sizeof(struct rules_t));
+    size_t capacity = 64;
+    if (rules == NULL || (rules->code = malloc(capacity)) == NULL)
+        handle_error("Couldn't allocate space for rules_t");
+    rules->size = 0;
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        ++line_no;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\0')
+            continue;
+        if (!rules_compile(rules, &capacity, line))
+        {
+            fprintf(stderr, "%s:%d: invalid rule\n", path, line_no);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(file);
+
+    return rules;
+}
+
+void
+rules_free(struct rules_t *rules)
+{
+    free(rules->code);
+    free(rules);
+}
+
+// Runs a single rule over the password in place and moves *code past
+// its OP_END, returns false if the candidate doesn't fit password_t
+static bool
+rules_run(const unsigned char **code, char *password, size_t *length)
+{
+    const unsigned char *pc = *code;
+    size_t len = *length;
+    while (true)
+    {
+        switch (*pc++)
+        {
+        case OP_END:
+            *code = pc;
+            *length = len;
+            return true;
+        case OP_NOOP:
+            break;
+        case OP_LOWER:
+            for (size_t i = 0; i < len; ++i)
+                password[i] = tolower((unsigned char) password[i]);
+            break;
+        case OP_UPPER:
+            for (size_t i = 0; i < len; ++i)
+                password[i] = toupper((unsigned char) password[i]);
+            break;
+        case OP_CAPITALIZE:
+            for (size_t i = 0; i < len; ++i)
+                password[i] = tolower((unsigned char) password[i]);
+            if (len > 0)
+                password[0] = toupper((unsigned char) password[0]);
+            break;
+        case OP_TOGGLE:
+            for (size_t i = 0; i < len; ++i)
+            {
+                unsigned char ch = password[i];
+                password[i] = islower(ch) ? toupper(ch) : tolower(ch);
+            }
+            break;
+        case OP_REVERSE:
+            for (size_t i = 0, j = len; i + 1 < j; ++i, --j)
+            {
+                char tmp = password[i];
+                password[i] = password[j - 1];
+                password[j - 1] = tmp;
+            }
+            break;
+        case OP_DUPLICATE:
+            if (2 * len >= PASSWORD_SIZE) goto reject;
+            memcpy(password + len, password, len);
+            len *= 2;
+            break;
+        case OP_APPEND:
+        {
+            // The argument is consumed first, reject skips opcodes only
+            char ch = *pc++;
+            if (len + 1 >= PASSWORD_SIZE) goto reject;
+            password[len++] = ch;
+            break;
+        }
+        case OP_PREPEND:
+        {
+            char ch = *pc++;
+            if (len + 1 >= PASSWORD_SIZE) goto reject;
+            memmove(password + 1, password, len++);
+            password[0] = ch;
+            break;
+        }
+        case OP_SUBSTITUTE:
+            for (size_t i = 0; i < len; ++i)
+                if (password[i] == (char) pc[0])
+                    password[i] = pc[1];
+            pc += 2;
+            break;
+        case OP_TRUNCATE_FIRST:
+            if (len > 0)
+                memmove(password, password + 1, --len);
+            break;
+        case OP_TRUNCATE_LAST:
+            if (len > 0) --len;
+            break;
+        }
+    }
+
+reject:
+    while (*pc != OP_END)
+    {
+        switch (*pc++)
+        {
+        case OP_APPEND:
+        case OP_PREPEND:
+            pc += 1;
+            break;
+        case OP_SUBSTITUTE:
+            pc += 2;
+            break;
+        }
+    }
+    *code = pc + 1;
+    return false;
+}
+
+bool
+rules_apply(struct rules_t *rules,
+            const char *word,
+            size_t length,
+            struct task_t *task,
+            void *context,
+            password_handler_t handler)
+{
+    const unsigned char *pc = rules->code;
+    const unsigned char *end = rules->code + rules->size;
+    while (pc < end)
+    {
+        size_t len = length;
+        memcpy(task->password, word, len);
+        if (!rules_run(&pc, task->password, &len))
+            continue;
+        task->password[len] = '\0';
+        if (handler(context, task))
+            return true;
+    }
+    return false;
+}
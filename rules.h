@@ -0,0 +1,43 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum rule_op_t
+{
+    OP_END,
+    OP_NOOP,
+    OP_LOWER,
+    OP_UPPER,
+    OP_CAPITALIZE,
+    OP_TOGGLE,
+    OP_REVERSE,
+    OP_DUPLICATE,
+    OP_APPEND,
+    OP_PREPEND,
+    OP_SUBSTITUTE,
+    OP_TRUNCATE_FIRST,
+    OP_TRUNCATE_LAST,
+};
+
+// Rules compiled back to back, each one terminated by OP_END
+struct rules_t
+{
+    unsigned char *code;
+    size_t size;
+};
+
+struct rules_t *
+rules_load(const char *path);
+
+void
+rules_free(struct rules_t *);
+
+bool
+rules_apply(struct rules_t *, const char *word, size_t length,
+            struct task_t *, void *context, password_handler_t);
+
+#endif // RULES_H
@@ -0,0 +1,97 @@
+#include "sched.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+int
+sched_split_level(struct config_t *job_config, int to)
+{
+    int level = split_point(job_config);
+    return (level < to) ? level : to;
+}
+
+int
+sched_next_job(struct sched_job_t *const *jobs, int count)
+{
+    int best = -1;
+    for (int i = 0; i < count; ++i)
+    {
+        if (jobs[i]->queued > 0
+            && (best < 0 || job_before(jobs[i]->job, jobs[i]->dispatched,
+                                       jobs[best]->job, jobs[best]->dispatched)))
+            best = i;
+    }
+    if (best >= 0)
+        sched_take(jobs[best]);
+    return best;
+}
+
+void
+sched_take(struct sched_job_t *job)
+{
+    --job->queued;
+    ++job->dispatched;
+}
+
+bool
+sched_queued(struct sched_job_t *const *jobs, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (jobs[i]->queued > 0)
+            return true;
+    }
+    return false;
+}
+
+bool
+sched_spec_release(struct sched_spec_t *spec, bool done, int *losers)
+{
+    if (spec == NULL)
+        return true;
+
+    bool first = !spec->done;
+    if (first && done)
+        spec->done = true;
+    else if (spec->done)
+        --*losers;
+    if (--spec->copies == 0)
+        free(spec);
+    else if (first && done)
+        ++*losers;
+    return first;
+}
+
+bool
+sched_requeue(const struct sched_spec_t *spec)
+{
+    return spec == NULL || (!spec->done && spec->copies == 1);
+}
+
+double
+sched_rate(double rate, double size, double seconds)
+{
+    if (seconds <= 0)
+        return rate;
+    // Halfway towards the last task, a runner's load changes over a job
+    return (rate > 0) ? (rate + size / seconds) / 2 : size / seconds;
+}
+
+double
+sched_copy_wait(double size, double elapsed, double rate, double copy_rate)
+{
+    if (copy_rate <= 0)
+        copy_rate = rate;
+    if (copy_rate <= 0)
+        return HUGE_VAL;
+    double copy = SCHED_COPY_MARGIN * size / copy_rate;
+    double expected = (rate > 0) ? size / rate : 0;
+    if (elapsed < expected)
+    {
+        if (expected - copy > elapsed)
+            return 0;
+        // Not until the other one is overdue
+        return ((expected > copy) ? expected : copy) - elapsed;
+    }
+    return (elapsed > copy) ? 0 : copy - elapsed;
+}
@@ -0,0 +1,72 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "common.h"
+#include "jobs.h"
+
+// How much sooner a copy has to be expected back, so that noise in the
+// measured rates never makes runners of the same speed copy each other
+#define SCHED_COPY_MARGIN 1.25
+
+// The coordinator's scheduling decisions, free of threads, sockets and
+// clocks so that the simulator runs the same policy as the server
+
+// Dispatch state of one job
+struct sched_job_t
+{
+    const struct job_t *job;
+    // Tasks waiting in the job's queue
+    int queued;
+    long long dispatched;
+};
+
+// Both copies of a task that is run again near the end of its job
+struct sched_spec_t
+{
+    int copies;
+    bool done;
+};
+
+// Level a job's tasks start at: the positions below it are enumerated by
+// whoever runs a task, the ones from it up to `to` are fixed per task
+int
+sched_split_level(struct config_t *job_config, int to);
+
+// Index of the job the next task is taken from, which is accounted as
+// dispatched, or -1 with nothing queued
+int
+sched_next_job(struct sched_job_t *const *jobs, int count);
+
+// Accounts for a task taken from the job by some other policy
+void
+sched_take(struct sched_job_t *job);
+
+bool
+sched_queued(struct sched_job_t *const *jobs, int count);
+
+// Releases one copy of a task once it finished, done, or was dropped.
+// True for the copy whose result counts. `losers` counts copies still
+// running for tasks the other copy finished. Frees the last one's spec.
+bool
+sched_spec_release(struct sched_spec_t *spec, bool done, int *losers);
+
+// Rate estimate of a runner that took `seconds` for a task of `size`,
+// from its previous estimate. Rates are in units of size per second and
+// 0 while unknown.
+double
+sched_rate(double rate, double size, double seconds);
+
+// Seconds until an idle runner at copy_rate is expected to finish a copy
+// of a task of `size` before the runner that started it `elapsed` seconds
+// ago at `rate`: 0 if it is now, HUGE_VAL if never. Overdue runners are
+// expected to take as long again as they already have, an idle runner
+// of unknown rate is taken to be as fast as the other one.
+double
+sched_copy_wait(double size, double elapsed, double rate, double copy_rate);
+
+// Whether a task whose runner went away, not yet released, goes back to
+// the queue: not while another copy of it is running or already finished
+bool
+sched_requeue(const struct sched_spec_t *spec);
+
+#endif // SCHED_H
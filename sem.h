@@ -2,6 +2,8 @@
 #define SEM_H
 
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
 
 typedef struct
 {
@@ -33,6 +35,30 @@ sem_wait(sem_t *sem)
     pthread_mutex_unlock(&sem->value_mutex);
 }
 
+// 0 once decremented, -1 with errno ETIMEDOUT past the deadline
+int
+sem_timedwait(sem_t *sem, const struct timespec *deadline)
+{
+    int status = 0;
+    pthread_mutex_lock(&sem->value_mutex);
+    pthread_cleanup_push(
+        (void (*) (void*)) pthread_mutex_unlock,
+        &sem->value_mutex
+    );
+    while (sem->value == 0 && status == 0)
+        status = pthread_cond_timedwait(&sem->sem_cond, &sem->value_mutex, deadline);
+    if (sem->value > 0)
+    {
+        --sem->value;
+        status = 0;
+    }
+    pthread_cleanup_pop(!0);
+    if (status == 0)
+        return 0;
+    errno = status;
+    return -1;
+}
+
 void
 sem_post(sem_t *sem)
 {
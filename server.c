@@ -1,9 +1,18 @@
+#define _GNU_SOURCE
 #include "server.h"
 
 #include "singlethreaded.h"
 #include "iterative.h"
 #include "recursive.h"
 #include "queue.h"
+#include "shm.h"
+#include "trace.h"
+#include "jobs.h"
+#include "sched.h"
+#include "potfile.h"
+#include "arena.h"
+#include "memcost.h"
+#include "client.h"
 #include "common.h"
 
 #include <string.h>
@@ -11,7 +20,11 @@
 #include <pthread.h>
 #include <alloca.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -57,7 +70,7 @@ set_insert(struct set_t *set, struct node_t node)
     if (set->size == set->capacity)
     {
         set->capacity *= 2;
-        set->data = realloc(set->data, set->capacity);
+        set->data = realloc(set->data, set->capacity * sizeof(struct node_t));
         if (set->data == NULL)
             handle_error("Couldn't reallocate space for set_t");
     }
@@ -71,7 +84,7 @@ set_take_last(struct set_t *set)
     if (set->size == set->capacity)
     {
         set->capacity *= 2;
-        set->data = realloc(set->data, set->capacity);
+        set->data = realloc(set->data, set->capacity * sizeof(struct node_t));
         if (set->data == NULL)
             handle_error("Couldn't reallocate space for set_t");
     }
@@ -100,23 +113,92 @@ set_destroy(struct set_t *set)
     free(set->data);
 }
 
+struct srv_context_t;
+struct srv_worker_t;
+
+// The task a client or local worker is running. Once a job has nothing
+// left to queue, idle ones run copies of the oldest of these, if they are
+// expected to finish first.
+struct srv_flight_t
+{
+    struct srv_flight_t *prev, *next;
+    struct srv_context_t *context;
+    struct srv_job_t *job;
+    struct task_t task;
+    long long seq;
+    struct sched_spec_t *spec;
+    // -1 for local workers
+    int socket_fd;
+    bool active, copy;
+    // Tasks of rate_job per second, 0 while unknown. The tasks of a job
+    // are all alike, the ones of different jobs aren't.
+    double rate;
+    struct srv_job_t *rate_job;
+    uint64_t started;
+    // Guards sent and cancelled, a client is only told to cancel the task
+    // once it was sent
+    pthread_mutex_t send_mutex;
+    bool sent;
+    volatile bool cancelled;
+};
+
+struct srv_job_t
+{
+    struct job_t job;
+    struct config_t config;
+    struct task_t task;
+    // Bounded per job, so one producer can't crowd out the others
+    struct queue_t queue;
+    // Guarded by sched_mutex
+    struct sched_job_t sched CACHE_ALIGNED;
+    // Guarded by tasks_mutex
+    volatile int tasks_running CACHE_ALIGNED;
+    // Copies still running for tasks the other copy finished
+    int losers;
+    volatile bool producing;
+    volatile bool found;
+    bool started, reported;
+    password_t password;
+    pthread_t producer;
+    struct srv_context_t *context;
+};
+
 struct srv_context_t
 {
-    volatile int tasks_running;
-    pthread_mutex_t tasks_mutex;
+    struct srv_job_t *jobs;
+    // The jobs' dispatch state, guarded by sched_mutex
+    struct sched_job_t **sched;
+    int job_count;
+    struct config_t *config;
+    struct arena_t jobs_arena, crypt_arena;
+
+    pthread_mutex_t tasks_mutex CACHE_ALIGNED;
     pthread_cond_t tasks_cond;
+    // Guarded by tasks_mutex as well
+    struct srv_flight_t *flights;
+    long long flight_seq, speculated, copies_first, cancelled;
+    // Threads that found nothing to copy and wait for a task
+    int idle;
 
-    struct set_t set;
+    // Tasks queued over all jobs
+    sem_t pending CACHE_ALIGNED;
+    pthread_mutex_t sched_mutex CACHE_ALIGNED;
+
+    struct set_t set CACHE_ALIGNED;
     pthread_mutex_t set_mutex;
-    struct queue_t queue;
-    password_t password;
-    char *hash;
-    volatile bool found;
-    volatile bool done;
+    sem_t thread_started;
 
-    pthread_mutex_t thread_started;
+    int server_socket;
+    pthread_t server_thread;
+    struct srv_worker_t *workers;
+    int worker_count;
+};
 
-    struct config_t *config;
+struct srv_worker_t
+{
+    struct srv_context_t *context;
+    int index;
+    pthread_t thread;
 };
 
 struct params_t
@@ -130,27 +212,61 @@ close_client(int client_sfd)
 {
     int status;
 
-    // Send tag
+    // Send tag and length, a client cut off in the middle of a task
+    // can't take them and is only disconnected
     enum command_t command = CMD_EXIT;
+    int length = 0;
+    status = sendall(client_sfd, &command, sizeof(command), MSG_NOSIGNAL);
+    if (status != -1)
+        status = sendall(client_sfd, &length, sizeof(length), MSG_NOSIGNAL);
+
+    // Client should close socket on its side and send EOF
+    if (status != -1)
+    {
+        char res;
+        recv(client_sfd, &res, sizeof(res), 0);
+    }
+
+    shutdown(client_sfd, SHUT_RDWR);
+    close(client_sfd);
+    return (status == -1) ? -1 : 0;
+}
+
+// Stops the client's task, sent in one piece for the client's watcher.
+// Never blocks, the caller holds tasks_mutex.
+static int
+send_cancel(const int client_sfd)
+{
+    int header[2] = { CMD_CANCEL, 0 };
+    int status = send(client_sfd, header, sizeof(header), MSG_NOSIGNAL | MSG_DONTWAIT);
+    return (status == sizeof(header)) ? 0 : -1;
+}
+
+// Switches the client to another job, it answers with 0 if it can run it
+static int
+send_job(const int client_sfd, struct job_desc_t *desc)
+{
+    int status;
+
+    enum command_t command = CMD_JOB;
     status = sendall(client_sfd, &command, sizeof(command), 0);
     if (status == -1) return -1;
 
-    // Send length
-    int length = 0;
+    int length = sizeof(struct job_desc_t);
     status = sendall(client_sfd, &length, sizeof(length), 0);
     if (status == -1) return -1;
 
-    // Client should close socket on its side and send EOF
-    char res;
-    status = recv(client_sfd, &res, sizeof(res), 0);
+    status = sendall(client_sfd, desc, length, 0);
+    if (status == -1) return -1;
 
-    shutdown(client_sfd, SHUT_RDWR);
-    close(client_sfd);
+    int reply;
+    status = recvall(client_sfd, &reply, sizeof(reply), 0);
+    if (status == -1 || reply != 0) return -1;
     return 0;
 }
 
 static int
-send_task(const int client_sfd, struct task_t *task, bool *result)
+send_task(const int client_sfd, struct task_t *task)
 {
     int status;
 
@@ -167,6 +283,13 @@ send_task(const int client_sfd, struct task_t *task, bool *result)
     // Send value
     status = sendall(client_sfd, task, length, 0);
     if (status == -1) return -1;
+    return 0;
+}
+
+static int
+recv_result(const int client_sfd, struct task_t *task, bool *result)
+{
+    int status;
 
     int size;
     status = recvall(client_sfd, &size, sizeof(size), 0);
@@ -182,42 +305,407 @@ send_task(const int client_sfd, struct task_t *task, bool *result)
     return 0;
 }
 
+static void
+send_task_shm(struct shm_channel_t *channel, struct task_t *task)
+{
+    struct shm_message_t message;
+    message.command = CMD_TASK;
+    message.task = *task;
+    shm_push(&channel->requests, &message);
+}
+
+static int
+recv_result_shm(struct shm_channel_t *channel, const int client_sfd,
+                struct task_t *task, bool *result)
+{
+    struct shm_message_t message;
+    if (shm_pop(&channel->responses, &message, client_sfd) == -1)
+        return -1;
+    if (message.found)
+        memcpy(task->password, message.task.password, sizeof(task->password));
+    *result = message.found;
+    return 0;
+}
+
+static bool
+srv_job_complete(struct srv_job_t *job)
+{
+    return job->found || (!job->producing && job->tasks_running == 0);
+}
+
+static void
+srv_job_push(struct srv_job_t *job, struct task_t *task)
+{
+    struct srv_context_t *context = job->context;
+    queue_push(&job->queue, task);
+
+    pthread_mutex_lock(&context->sched_mutex);
+    ++job->sched.queued;
+    pthread_mutex_unlock(&context->sched_mutex);
+    sem_post(&context->pending);
+}
+
+// NULL when woken up by srv_job_produced without a task, or once wait
+// seconds passed without one
+static struct srv_job_t *
+srv_next_task(struct srv_context_t *context, struct task_t *task, double wait)
+{
+    uint64_t start = trace_begin();
+    bool woken = true;
+    if (isinf(wait))
+        sem_wait(&context->pending);
+    else
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long nsec = deadline.tv_nsec + (long long) (wait * 1e9) + 1;
+        deadline.tv_sec += nsec / 1000000000;
+        deadline.tv_nsec = nsec % 1000000000;
+        while (!(woken = (sem_timedwait(&context->pending, &deadline) == 0))
+               && errno == EINTR)
+            ;
+    }
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    --context->idle;
+    pthread_mutex_unlock(&context->tasks_mutex);
+    if (!woken)
+    {
+        trace_end("next_task", H_QUEUE_WAIT, start);
+        return NULL;
+    }
+
+    // Pending tokens stand for tasks already in some job's queue, plus
+    // the wake ups
+    pthread_mutex_lock(&context->sched_mutex);
+    int index = sched_next_job(context->sched, context->job_count);
+    pthread_mutex_unlock(&context->sched_mutex);
+    if (index < 0)
+    {
+        trace_end("next_task", H_QUEUE_WAIT, start);
+        return NULL;
+    }
+
+    struct srv_job_t *best = &context->jobs[index];
+    queue_pop(&best->queue, task);
+    trace_end("next_task", H_QUEUE_WAIT, start);
+    return best;
+}
+
+static struct srv_flight_t *
+srv_flight_add(struct srv_context_t *context, int socket_fd)
+{
+    struct srv_flight_t *flight = calloc(1, sizeof(struct srv_flight_t));
+    if (flight == NULL)
+        handle_error("Couldn't allocate space for srv_flight_t");
+    flight->context = context;
+    flight->socket_fd = socket_fd;
+    pthread_mutex_init(&flight->send_mutex, NULL);
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    flight->next = context->flights;
+    if (context->flights != NULL)
+        context->flights->prev = flight;
+    context->flights = flight;
+    pthread_mutex_unlock(&context->tasks_mutex);
+    return flight;
+}
+
+// Cleanup of the threads running tasks, a client cancelled in the middle
+// of one is cut off so that closing it doesn't wait for the result
+static void
+srv_flight_remove(void *arg)
+{
+    struct srv_flight_t *flight = (struct srv_flight_t *) arg;
+    struct srv_context_t *context = flight->context;
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    if (flight->active && flight->socket_fd != -1)
+        shutdown(flight->socket_fd, SHUT_RDWR);
+    if (flight->prev != NULL)
+        flight->prev->next = flight->next;
+    else
+        context->flights = flight->next;
+    if (flight->next != NULL)
+        flight->next->prev = flight->prev;
+    pthread_mutex_unlock(&context->tasks_mutex);
+    pthread_mutex_destroy(&flight->send_mutex);
+    free(flight);
+}
+
+static void
+srv_flight_begin(struct srv_flight_t *flight, struct srv_job_t *job,
+                 struct task_t *task)
+{
+    struct srv_context_t *context = job->context;
+    pthread_mutex_lock(&context->tasks_mutex);
+    flight->job = job;
+    flight->task = *task;
+    flight->seq = context->flight_seq++;
+    flight->spec = NULL;
+    flight->active = true;
+    flight->copy = false;
+    flight->started = trace_now();
+    flight->sent = false;
+    flight->cancelled = false;
+    pthread_mutex_unlock(&context->tasks_mutex);
+}
+
+// Rate of the flight's runner on its current job, 0 while unknown
+static double
+srv_flight_rate(struct srv_flight_t *flight, struct srv_job_t *job)
+{
+    return (flight->rate_job == job) ? flight->rate : 0;
+}
+
+// With no task queued anywhere, an idle client or worker runs a copy of
+// the oldest task of a job that has been split completely, if it is
+// expected to finish the copy first. The first copy to finish counts,
+// the other one is cancelled. Otherwise wait is how many seconds to wait
+// for a task before looking again.
+static struct srv_job_t *
+srv_speculate(struct srv_context_t *context, struct srv_flight_t *self,
+              struct task_t *task, double *wait)
+{
+    pthread_mutex_lock(&context->sched_mutex);
+    bool queued = sched_queued(context->sched, context->job_count);
+    pthread_mutex_unlock(&context->sched_mutex);
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    uint64_t now = trace_now();
+    struct srv_flight_t *oldest = NULL;
+    *wait = HUGE_VAL;
+    for (struct srv_flight_t *flight = queued ? NULL : context->flights;
+         flight != NULL; flight = flight->next)
+    {
+        if (flight == self || !flight->active || flight->spec != NULL
+            || flight->job->producing || flight->job->found)
+            continue;
+        double elapsed = (now > flight->started) ? (now - flight->started) / 1e9 : 0;
+        double until = sched_copy_wait(1, elapsed, srv_flight_rate(flight, flight->job),
+                                       srv_flight_rate(self, flight->job));
+        if (until > 0)
+        {
+            if (until < *wait)
+                *wait = until;
+        }
+        else if (oldest == NULL || flight->seq < oldest->seq)
+            oldest = flight;
+    }
+    struct sched_spec_t *spec = (oldest != NULL) ? malloc(sizeof(struct sched_spec_t)) : NULL;
+    struct srv_job_t *job = NULL;
+    if (spec != NULL)
+    {
+        spec->copies = 2;
+        spec->done = false;
+        oldest->spec = spec;
+        job = oldest->job;
+        *task = oldest->task;
+        self->job = job;
+        self->task = oldest->task;
+        self->seq = context->flight_seq++;
+        self->spec = spec;
+        self->active = true;
+        self->copy = true;
+        self->started = now;
+        self->sent = false;
+        self->cancelled = false;
+        ++context->speculated;
+    }
+    else
+    {
+        // Counted under the same lock as producing, so srv_job_produced
+        // can't miss the caller about to wait in srv_next_task
+        ++context->idle;
+    }
+    pthread_mutex_unlock(&context->tasks_mutex);
+    return job;
+}
+
+// Called with tasks_mutex held once a job is split completely. Threads
+// waiting on an empty queue get a token without a task, so that they
+// look for stragglers to copy.
+static void
+srv_job_produced(struct srv_job_t *job)
+{
+    struct srv_context_t *context = job->context;
+    job->producing = false;
+    for (int i = 0; i < context->idle; ++i)
+        sem_post(&context->pending);
+}
+
+// Called with tasks_mutex held once one copy of a task finished first,
+// the other ones stop instead of running to the end
+static void
+srv_cancel_copies(struct srv_context_t *context, struct sched_spec_t *spec)
+{
+    for (struct srv_flight_t *flight = context->flights; flight != NULL;
+         flight = flight->next)
+    {
+        if (flight->spec != spec)
+            continue;
+        pthread_mutex_lock(&flight->send_mutex);
+        flight->cancelled = true;
+        if (flight->sent && flight->socket_fd != -1)
+            send_cancel(flight->socket_fd);
+        pthread_mutex_unlock(&flight->send_mutex);
+        ++context->cancelled;
+    }
+}
+
+// Releases the flight's share of a copied task, true for the copy that
+// finished first
+static bool
+srv_spec_release(struct srv_flight_t *flight, bool done)
+{
+    struct sched_spec_t *spec = flight->spec;
+    flight->spec = NULL;
+    flight->active = false;
+
+    struct srv_job_t *job = flight->job;
+    bool others = (spec != NULL && spec->copies > 1);
+    bool first = sched_spec_release(spec, done, &job->losers);
+    if (first && done && others)
+        srv_cancel_copies(job->context, spec);
+    if (first && done && flight->copy)
+        ++job->context->copies_first;
+    return first;
+}
+
+static void
+srv_task_done(struct srv_job_t *job, struct task_t *task, bool found,
+              struct srv_flight_t *flight)
+{
+    struct srv_context_t *context = job->context;
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    if (flight != NULL && !flight->cancelled)
+    {
+        double seconds = (trace_now() - flight->started) / 1e9;
+        flight->rate = sched_rate(srv_flight_rate(flight, job), 1, seconds);
+        flight->rate_job = job;
+    }
+    bool first = (flight == NULL) || srv_spec_release(flight, true);
+    if (first && found && !job->found)
+    {
+        memcpy(job->password, task->password, sizeof(task->password));
+        job->found = true;
+    }
+    if (first)
+        --job->tasks_running;
+    if (srv_job_complete(job) || (!first && job->losers == 0))
+        pthread_cond_signal(&context->tasks_cond);
+    pthread_mutex_unlock(&context->tasks_mutex);
+}
+
+// A task whose client went away goes back to the queue, unless another
+// copy of it is still running or already finished
+static void
+srv_task_abort(struct srv_job_t *job, struct task_t *task,
+               struct srv_flight_t *flight)
+{
+    struct srv_context_t *context = job->context;
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    bool requeue = sched_requeue(flight->spec);
+    if (!srv_spec_release(flight, false) && job->losers == 0)
+        pthread_cond_signal(&context->tasks_cond);
+    pthread_mutex_unlock(&context->tasks_mutex);
+
+    if (requeue)
+        srv_job_push(job, task);
+}
+
+static void
+srv_channel_cleanup(void *arg)
+{
+    if (arg != NULL)
+        shm_close((struct shm_channel_t *) arg);
+}
+
 static void *
 serve_client(void *arg)
 {
     struct params_t *params = (struct params_t *) arg;
     struct srv_context_t *context = (struct srv_context_t *) params->context;
     int client_sfd = params->socket_fd;
-    pthread_mutex_unlock(&context->thread_started);
+    sem_post(&context->thread_started);
+    trace_thread("serve_client");
+
+    // Clients on this host get tasks through shared memory instead
+    struct shm_channel_t *channel = shm_offer(client_sfd);
+    if (channel != NULL)
+        fprintf(stderr, "Using shared memory transport...\n");
+    pthread_cleanup_push(srv_channel_cleanup, channel);
+    struct srv_flight_t *flight = srv_flight_add(context, client_sfd);
+    pthread_cleanup_push(srv_flight_remove, flight);
 
+    struct srv_job_t *current = NULL;
+    int current_id = 0;
     while (true)
     {
-        struct task_t task;
-        queue_pop(&context->queue, &task);
+        struct task_t task, sent;
+        double wait;
+        struct srv_job_t *job = srv_speculate(context, flight, &task, &wait);
+        if (job == NULL)
+        {
+            job = srv_next_task(context, &task, wait);
+            if (job == NULL)
+                continue;
+            if (job->found)
+            {
+                srv_task_done(job, &task, false, NULL);
+                continue;
+            }
+            srv_flight_begin(flight, job, &task);
+        }
 
-        task.to = task.from;
-        task.from = 0;
+        // A relay reuses its job for every upstream job, with a new id
+        if (job != current || job->job.desc.id != current_id)
+        {
+            // Job descriptors always go over the socket, which also pulls
+            // a shared memory client out of its ring
+            if (send_job(client_sfd, &job->job.desc) == -1)
+            {
+                srv_task_abort(job, &task, flight);
+                break;
+            }
+            current = job;
+            current_id = job->job.desc.id;
+        }
+
+        sent = task;
+        sent.to = sent.from;
+        sent.from = 0;
         bool found = false;
-        int status = send_task(client_sfd, &task, &found);
+        uint64_t start = trace_begin();
+        // A copy may have lost before it was even sent
+        int status = 0;
+        bool cancelled;
+        pthread_mutex_lock(&flight->send_mutex);
+        pthread_cleanup_push((void (*) (void *)) pthread_mutex_unlock,
+                             &flight->send_mutex);
+        cancelled = flight->cancelled;
+        if (!cancelled && channel != NULL)
+            send_task_shm(channel, &sent);
+        else if (!cancelled)
+            status = send_task(client_sfd, &sent);
+        flight->sent = true;
+        pthread_cleanup_pop(!0);
+        if (status != -1 && !cancelled)
+            status = (channel != NULL)
+                ? recv_result_shm(channel, client_sfd, &sent, &found)
+                : recv_result(client_sfd, &sent, &found);
+        trace_end("send_task", H_TASK, start);
         if (status == -1)
         {
-            queue_push(&context->queue, &task);
+            srv_task_abort(job, &task, flight);
             break;
         }
-        if (found)
-        {
-            memcpy(context->password, task.password, sizeof(task.password));
-            context->found = true;
-            context->done = true;
-        }
-
-        pthread_mutex_lock(&context->tasks_mutex);
-        --context->tasks_running;
-        pthread_mutex_unlock(&context->tasks_mutex);
-
-        if (context->tasks_running == 0 || context->found)
-            pthread_cond_signal(&context->tasks_cond);
+        srv_task_done(job, &sent, found, flight);
     }
+    pthread_cleanup_pop(!0);
+    pthread_cleanup_pop(!0);
 
     pthread_mutex_lock(&context->set_mutex);
     set_remove_sock(&context->set, client_sfd);
@@ -227,25 +715,89 @@ serve_client(void *arg)
     return NULL;
 }
 
+// Local compute on the coordinator, drawing from the same queues as clients
+static void *
+srv_worker(void *arg)
+{
+    struct srv_worker_t *worker = (struct srv_worker_t *) arg;
+    struct srv_context_t *context = worker->context;
+
+    struct st_context_t st_context;
+    st_context.cd = arena_slot(&context->crypt_arena, worker->index);
+    trace_thread("srv_worker");
+    struct srv_flight_t *flight = srv_flight_add(context, -1);
+    st_context.stop = &flight->cancelled;
+    pthread_cleanup_push(srv_flight_remove, flight);
+
+    while (true)
+    {
+        struct task_t task;
+        double wait;
+        struct srv_job_t *job = srv_speculate(context, flight, &task, &wait);
+        if (job == NULL)
+        {
+            job = srv_next_task(context, &task, wait);
+            if (job == NULL)
+                continue;
+            if (job->found)
+            {
+                srv_task_done(job, &task, false, NULL);
+                continue;
+            }
+            srv_flight_begin(flight, job, &task);
+        }
+
+        st_context.hash = job->config.hash;
+        task.to = task.from;
+        task.from = 0;
+        uint64_t start = trace_begin();
+        bool found = process_task(&task, &job->config, &st_context,
+                                  st_password_handler);
+        trace_end("task", H_TASK, start);
+        srv_task_done(job, &task, found, flight);
+    }
+    pthread_cleanup_pop(!0);
+    return NULL;
+}
+
 static bool
 srv_password_handler(void *context, struct task_t *task)
 {
-    struct srv_context_t *ctx = (struct srv_context_t *) context;
+    struct srv_job_t *job = (struct srv_job_t *) context;
+
+    pthread_mutex_lock(&job->context->tasks_mutex);
+    ++job->tasks_running;
+    pthread_mutex_unlock(&job->context->tasks_mutex);
+
+    srv_job_push(job, task);
+    return job->found;
+}
+
+// Splits one job into tasks, all jobs are split concurrently so the
+// fleet moves on to the next job as soon as one runs dry
+static void *
+srv_producer(void *arg)
+{
+    struct srv_job_t *job = (struct srv_job_t *) arg;
+    struct srv_context_t *context = job->context;
 
-    pthread_mutex_lock(&ctx->tasks_mutex);
-    ++ctx->tasks_running;
-    pthread_mutex_unlock(&ctx->tasks_mutex);
+    job->task.from = sched_split_level(&job->config, job->config.length);
+    job->task.to = job->config.length;
+    split_task(&job->task, &job->config, job, srv_password_handler);
 
-    queue_push(&ctx->queue, task);
-    return (ctx->password[0] != 0);
+    pthread_mutex_lock(&context->tasks_mutex);
+    srv_job_produced(job);
+    if (srv_job_complete(job))
+        pthread_cond_signal(&context->tasks_cond);
+    pthread_mutex_unlock(&context->tasks_mutex);
+    return NULL;
 }
 
 static void *
 srv_server(void *arg)
 {
-    struct params_t *params = (struct params_t *) arg;
-    struct srv_context_t *context = (struct srv_context_t *) params->context;
-    int server_sfd = params->socket_fd;
+    struct srv_context_t *context = (struct srv_context_t *) arg;
+    int server_sfd = context->server_socket;
 
     while (true)
     {
@@ -270,7 +822,8 @@ srv_server(void *arg)
         );
         if (status == 0)
         {
-            pthread_mutex_lock(&context->thread_started);
+            // Wait until the thread has copied params out of this scope
+            sem_wait(&context->thread_started);
         }
         else
         {
@@ -284,30 +837,82 @@ srv_server(void *arg)
     return NULL;
 }
 
-bool
-run_server(struct task_t *task, struct config_t *config)
+static void
+srv_job_init(struct srv_job_t *job, struct srv_context_t *context,
+             struct job_t *desc, struct task_t *task)
 {
-    struct srv_context_t context;
-    context.hash = config->hash;
-    context.tasks_running = 0;
-    pthread_mutex_init(&context.thread_started, NULL);
-    pthread_mutex_init(&context.tasks_mutex, NULL);
-    pthread_mutex_init(&context.set_mutex, NULL);
-    pthread_cond_init(&context.tasks_cond, NULL);
-    context.password[0] = 0;
-    context.config = config;
-    context.done = false;
-    context.found = false;
-    queue_init(&context.queue);
-    set_init(&context.set);
+    job->job = *desc;
+    job->config = *context->config;
+    job_apply(&job->job.desc, &job->config);
+    job->task = *task;
+    job->task.password[job->config.length] = '\0';
+    queue_init(&job->queue);
+    job->sched.job = &job->job;
+    job->sched.queued = 0;
+    job->sched.dispatched = 0;
+    context->sched[job - context->jobs] = &job->sched;
+    job->tasks_running = 0;
+    job->losers = 0;
+    job->producing = true;
+    job->found = false;
+    job->reported = false;
+    job->password[0] = 0;
+    job->context = context;
+}
+
+static void
+srv_report(struct srv_job_t *job, struct config_t *config)
+{
+    if (job->found && config->potfile_path != NULL)
+        potfile_append(config->potfile_path, job->config.hash, job->password);
+    if (job->found)
+        printf("%s: Password found: '%s'\n", job->config.hash, job->password);
+    else
+        printf("%s: Password not found\n", job->config.hash);
+    fflush(stdout);
+}
+
+static void
+srv_context_init(struct srv_context_t *context, struct config_t *config,
+                 int job_count)
+{
+    sem_init(&context->thread_started, 0, 0);
+    sem_init(&context->pending, 0, 0);
+    pthread_mutex_init(&context->tasks_mutex, NULL);
+    pthread_mutex_init(&context->set_mutex, NULL);
+    pthread_mutex_init(&context->sched_mutex, NULL);
+    pthread_cond_init(&context->tasks_cond, NULL);
+    context->flights = NULL;
+    context->flight_seq = context->speculated = context->copies_first = 0;
+    context->cancelled = 0;
+    context->idle = 0;
+    context->config = config;
+    set_init(&context->set);
+
+    context->job_count = job_count;
+    // malloc wouldn't honour the cache line alignment of the jobs
+    if (arena_init(&context->jobs_arena, sizeof(struct srv_job_t), job_count) == -1)
+        handle_error("mmap");
+    context->jobs = arena_slot(&context->jobs_arena, 0);
+    context->sched = malloc(job_count * sizeof(struct sched_job_t *));
+    if (context->sched == NULL)
+        handle_error("Couldn't allocate space for the dispatch state");
+}
 
+// Clients are accepted on port by a thread of its own
+static void
+srv_listen(struct srv_context_t *context, int port)
+{
     int server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket == -1)
         handle_error("socket");
+    // Cut off clients leave the port in TIME_WAIT for the next server
+    int reuse = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
     struct sockaddr_in server_address;
     server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(config->port);
+    server_address.sin_port = htons(port);
     server_address.sin_addr.s_addr = INADDR_ANY;
 
     if (bind(server_socket, (struct sockaddr*) &server_address, sizeof(server_address)))
@@ -316,37 +921,236 @@ run_server(struct task_t *task, struct config_t *config)
     if (listen(server_socket, MAX_CLIENTS) == -1)
         handle_error("listen");
 
-    pthread_t server_thread;
-    pthread_create(&server_thread, NULL, srv_server, 
-                   (void *) &(struct params_t) { &context, server_socket });
+    context->server_socket = server_socket;
+    pthread_create(&context->server_thread, NULL, srv_server, context);
+}
 
-    task->from = 2;
-    task->to = config->length;
-    process_task(task, config, &context, srv_password_handler);
-    context.done = true;
+static void
+srv_start_workers(struct srv_context_t *context, int worker_count)
+{
+    if (arena_init(&context->crypt_arena, sizeof(struct crypt_data), worker_count) == -1)
+        handle_error("mmap");
+    context->worker_count = worker_count;
+    context->workers = calloc(worker_count + 1, sizeof(struct srv_worker_t));
+    if (context->workers == NULL)
+        handle_error("Couldn't allocate space for srv_worker_t");
+    for (int i = 0; i < worker_count; ++i)
+    {
+        struct srv_worker_t *worker = &context->workers[i];
+        worker->context = context;
+        worker->index = i;
+        pthread_create(&worker->thread, NULL, srv_worker, worker);
+    }
+}
+
+// Local workers first, then the clients and the thread accepting them
+static void
+srv_shutdown(struct srv_context_t *context)
+{
+    for (int i = 0; i < context->worker_count; ++i)
+    {
+        pthread_cancel(context->workers[i].thread);
+        pthread_join(context->workers[i].thread, NULL);
+    }
+
+    pthread_mutex_lock(&context->set_mutex);
+    for (int i = 0; i < context->set.size; ++i)
+    {
+        pthread_t thread = context->set.data[i].thread_id;
+        pthread_cancel(thread);
+        pthread_join(thread, NULL);
+        close_client(context->set.data[i].socket_fd);
+    }
+    pthread_mutex_unlock(&context->set_mutex);
+
+    pthread_cancel(context->server_thread);
+    pthread_join(context->server_thread, NULL);
+
+    for (int i = 0; i < context->job_count; ++i)
+        queue_destroy(&context->jobs[i].queue);
+    arena_destroy(&context->jobs_arena);
+    free(context->sched);
+    arena_destroy(&context->crypt_arena);
+    free(context->workers);
+    sem_close(&context->pending);
+    sem_close(&context->thread_started);
+    set_destroy(&context->set);
+    close(context->server_socket);
+}
+
+bool
+run_server(struct task_t *task, struct config_t *config)
+{
+    // Without a job file the command line describes the only job
+    struct job_t single;
+    struct job_list_t single_list = { &single, 1 };
+    struct job_list_t *list = &single_list;
+    if (config->jobs_path != NULL)
+    {
+        list = jobs_load(config->jobs_path, config);
+    }
+    else
+    {
+        job_from_config(&single, 0, config);
+    }
+
+    struct task_t template = *task;
+    if (config->jobs_path != NULL)
+        template.offset = template.end = 0;
+    struct srv_context_t context;
+    srv_context_init(&context, config, list->count);
+    for (int i = 0; i < list->count; ++i)
+        srv_job_init(&context.jobs[i], &context, &list->jobs[i], &template);
+
+    // Hashes cracked before are reported without being queued
+    int jobs_left = context.job_count;
+    if (config->jobs_path != NULL && config->potfile_path != NULL)
+    {
+        struct potfile_t *pot = potfile_load(config->potfile_path);
+        for (int i = 0; i < list->count; ++i)
+        {
+            struct srv_job_t *job = &context.jobs[i];
+            const char *password = potfile_find(pot, job->config.hash);
+            if (password == NULL)
+                continue;
+            strncpy(job->password, password, sizeof(job->password) - 1);
+            job->password[sizeof(job->password) - 1] = '\0';
+            job->found = true;
+            job->producing = false;
+            job->reported = true;
+            --jobs_left;
+            printf("%s: Password found: '%s'\n", job->config.hash, job->password);
+        }
+        potfile_free(pot);
+    }
+
+    srv_listen(&context, config->port);
+
+    int cpu_count = thread_count(config);
+    int worker_count = cpu_count - config->reserved_cores;
+    if (worker_count < 0) worker_count = 0;
+    // Local workers may run any job, so the most memory-hard one bounds them
+    for (int i = 0; i < context.job_count && worker_count > 0; ++i)
+        worker_count = memcost_threads(&context.jobs[i].config, worker_count);
+    srv_start_workers(&context, worker_count);
+
+    for (int i = 0; i < context.job_count; ++i)
+    {
+        context.jobs[i].started = !context.jobs[i].reported;
+        if (context.jobs[i].started)
+            pthread_create(&context.jobs[i].producer, NULL, srv_producer,
+                           &context.jobs[i]);
+    }
 
+    // Jobs are reported in the order they complete
     pthread_mutex_lock(&context.tasks_mutex);
-    pthread_cond_wait(&context.tasks_cond, &context.tasks_mutex);
+    while (jobs_left != 0)
+    {
+        for (int i = 0; i < context.job_count; ++i)
+        {
+            struct srv_job_t *job = &context.jobs[i];
+            if (job->reported || !srv_job_complete(job))
+                continue;
+            job->reported = true;
+            --jobs_left;
+            if (config->jobs_path != NULL)
+                srv_report(job, config);
+        }
+        if (jobs_left != 0)
+            pthread_cond_wait(&context.tasks_cond, &context.tasks_mutex);
+    }
+    if (context.speculated != 0)
+        fprintf(stderr, "Ran copies of %lld straggling tasks, %lld finished first, "
+                "%lld losers cancelled\n",
+                context.speculated, context.copies_first, context.cancelled);
     pthread_mutex_unlock(&context.tasks_mutex);
 
-    memcpy(task->password, context.password, sizeof(context.password));
+    // Producers of found jobs stop at their next task, the ones that are
+    // blocked on a full queue are released by the consumers dropping tasks
+    for (int i = 0; i < context.job_count; ++i)
+    {
+        if (context.jobs[i].started)
+            pthread_join(context.jobs[i].producer, NULL);
+    }
+
+    memcpy(task->password, context.jobs[0].password, sizeof(task->password));
+    bool found = context.jobs[0].found;
+
+    srv_shutdown(&context);
+    if (config->jobs_path != NULL)
+        jobs_free(list);
+
+    return found;
+}
+
+// Each task from upstream is split further for the relay's own clients
+// and workers, and only completes once all its parts have
+static bool
+srv_relay_runner(void *arg, struct task_t *task, struct config_t *config)
+{
+    struct srv_context_t *context = (struct srv_context_t *) arg;
+    struct srv_job_t *job = &context->jobs[0];
 
-    pthread_mutex_lock(&context.set_mutex);
-    for (int i = 0; i < context.set.size; ++i)
+    // A new id makes the clients take the job over again
+    struct job_t next;
+    job_from_config(&next, job->job.desc.id, config);
+    if (memcmp(&next.desc, &job->job.desc, sizeof(next.desc)) != 0)
     {
-        pthread_t thread = context.set.data[i].thread_id;
-        pthread_cancel(thread);
-        pthread_join(thread, NULL);
-        close_client(context.set.data[i].socket_fd);
+        // Copies the previous job lost still read its config
+        pthread_mutex_lock(&context->tasks_mutex);
+        while (job->losers != 0)
+            pthread_cond_wait(&context->tasks_cond, &context->tasks_mutex);
+        pthread_mutex_unlock(&context->tasks_mutex);
+
+        next.desc.id = job->job.desc.id + 1;
+        job->job = next;
+        job->config = *config;
+        job_apply(&job->job.desc, &job->config);
     }
-    pthread_mutex_unlock(&context.set_mutex);
 
-    pthread_cancel(server_thread);
-    pthread_join(server_thread, NULL);
+    // The previous task has no parts left in flight, so the job is reused
+    pthread_mutex_lock(&context->tasks_mutex);
+    job->found = false;
+    job->producing = true;
+    pthread_mutex_unlock(&context->tasks_mutex);
+
+    uint64_t start = trace_begin();
+    struct task_t parts = *task;
+    parts.from = sched_split_level(&job->config, task->to);
+    process_task(&parts, &job->config, job, srv_password_handler);
+
+    pthread_mutex_lock(&context->tasks_mutex);
+    srv_job_produced(job);
+    while (job->tasks_running != 0)
+        pthread_cond_wait(&context->tasks_cond, &context->tasks_mutex);
+    bool found = job->found;
+    if (found)
+        memcpy(task->password, job->password, sizeof(task->password));
+    pthread_mutex_unlock(&context->tasks_mutex);
+    trace_end("relay_task", H_TASK, start);
+    return found;
+}
+
+bool
+run_relay(struct task_t *task, struct config_t *config)
+{
+    struct srv_context_t context;
+    srv_context_init(&context, config, 1);
+    struct job_t job;
+    job_from_config(&job, 0, config);
+    srv_job_init(&context.jobs[0], &context, &job, task);
+    context.jobs[0].producing = false;
+
+    srv_listen(&context, config->relay_port);
+    // Jobs only arrive from upstream, so memory-hard hashes can't bound
+    // the local workers in advance
+    int worker_count = thread_count(config) - config->reserved_cores;
+    if (worker_count < 0) worker_count = 0;
+    srv_start_workers(&context, worker_count);
 
-    queue_destroy(&context.queue);
-    set_destroy(&context.set);
-    close(server_socket);
+    // Cancelled tasks run to the end, their parts are spread over clients
+    bool found = client_serve(task, config, srv_relay_runner, &context, NULL);
 
-    return context.found;
+    srv_shutdown(&context);
+    return found;
 }
@@ -9,4 +9,9 @@ struct config_t;
 bool
 run_server(struct task_t *, struct config_t *);
 
+// Takes large tasks from the coordinator at config->address and serves
+// parts of them to its own clients on config->relay_port
+bool
+run_relay(struct task_t *, struct config_t *);
+
 #endif // SERVER_H
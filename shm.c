@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include "shm.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define SHM_MAGIC 0x6272757465736d31ULL
+// Polls before the consumer goes to sleep on the futex
+#define SHM_SPIN 4096
+// Sleeping consumers wake up this often to check the peer is alive
+#define SHM_TIMEOUT_NS 50000000
+
+#ifdef __linux__
+
+static void
+futex_wait(uint32_t *addr, uint32_t value)
+{
+    struct timespec timeout = { 0, SHM_TIMEOUT_NS };
+    syscall(SYS_futex, addr, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void
+futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Both ends have to be on one machine to share memory
+static bool
+same_host(int socket_fd)
+{
+    struct sockaddr_in local, peer;
+    socklen_t local_len = sizeof(local), peer_len = sizeof(peer);
+    if (getsockname(socket_fd, (struct sockaddr *) &local, &local_len) == -1
+        || getpeername(socket_fd, (struct sockaddr *) &peer, &peer_len) == -1)
+        return false;
+    return local.sin_family == AF_INET && peer.sin_family == AF_INET
+        && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+static struct shm_channel_t *
+shm_map(int fd)
+{
+    void *data = mmap(NULL, sizeof(struct shm_channel_t),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return (data == MAP_FAILED) ? NULL : data;
+}
+
+struct shm_channel_t *
+shm_offer(int socket_fd)
+{
+    if (!same_host(socket_fd))
+        return NULL;
+
+    struct shm_offer_t offer;
+    memset(&offer, 0, sizeof(offer));
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    offer.nonce = ((uint64_t) now.tv_nsec << 32) ^ now.tv_sec ^ (uint64_t) getpid();
+    snprintf(offer.name, sizeof(offer.name), "/brute-%d-%d-%llx",
+             (int) getpid(), socket_fd, (unsigned long long) offer.nonce);
+
+    int fd = shm_open(offer.name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1)
+        return NULL;
+    struct shm_channel_t *channel = NULL;
+    if (ftruncate(fd, sizeof(struct shm_channel_t)) == 0)
+        channel = shm_map(fd);
+    close(fd);
+    if (channel == NULL)
+    {
+        shm_unlink(offer.name);
+        return NULL;
+    }
+    channel->magic = SHM_MAGIC;
+    channel->nonce = offer.nonce;
+
+    // The nonce tells a client on another host with a clashing name apart
+    int status = 0, reply = -1;
+    enum command_t command = CMD_SHM;
+    int length = sizeof(offer);
+    if (sendall(socket_fd, &command, sizeof(command), 0) == -1
+        || sendall(socket_fd, &length, sizeof(length), 0) == -1
+        || sendall(socket_fd, &offer, length, 0) == -1
+        || recvall(socket_fd, &reply, sizeof(reply), 0) == -1)
+        status = -1;
+    shm_unlink(offer.name);
+
+    if (status == -1 || reply != 0)
+    {
+        shm_close(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+struct shm_channel_t *
+shm_accept(int socket_fd, int length)
+{
+    struct shm_offer_t offer;
+    if (length != sizeof(offer) || recvall(socket_fd, &offer, length, 0) == -1)
+        return NULL;
+    offer.name[sizeof(offer.name) - 1] = '\0';
+
+    struct shm_channel_t *channel = NULL;
+    int fd = shm_open(offer.name, O_RDWR, 0);
+    if (fd != -1)
+    {
+        channel = shm_map(fd);
+        close(fd);
+    }
+    if (channel != NULL
+        && (channel->magic != SHM_MAGIC || channel->nonce != offer.nonce))
+    {
+        shm_close(channel);
+        channel = NULL;
+    }
+
+    int reply = (channel != NULL) ? 0 : -1;
+    if (sendall(socket_fd, &reply, sizeof(reply), 0) == -1 && channel != NULL)
+    {
+        shm_close(channel);
+        channel = NULL;
+    }
+    return channel;
+}
+
+void
+shm_close(struct shm_channel_t *channel)
+{
+    munmap(channel, sizeof(struct shm_channel_t));
+}
+
+void
+shm_push(struct shm_ring_t *ring, struct shm_message_t *message)
+{
+    uint32_t tail = ring->tail;
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SHM_RING_SIZE)
+        sched_yield();
+
+    ring->slots[tail % SHM_RING_SIZE] = *message;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST))
+        futex_wake(&ring->tail);
+}
+
+// Returns -1 when the peer closed the socket or sent anything over it,
+// which makes the ring owner fall back to the socket
+int
+shm_pop(struct shm_ring_t *ring, struct shm_message_t *message, int socket_fd)
+{
+    uint32_t head = ring->head;
+    for (int i = 0; i < SHM_SPIN; ++i)
+    {
+        if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head)
+            goto ready;
+    }
+
+    while (true)
+    {
+        __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        if (tail == head)
+            futex_wait(&ring->tail, tail);
+        __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head)
+            break;
+
+        pthread_testcancel();
+        char byte;
+        ssize_t peeked = recv(socket_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+        if (peeked != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return -1;
+    }
+
+ready:
+    *message = ring->slots[head % SHM_RING_SIZE];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+#else
+
+struct shm_channel_t *
+shm_offer(int socket_fd)
+{
+    return NULL;
+}
+
+struct shm_channel_t *
+shm_accept(int socket_fd, int length)
+{
+    // Read the offer to keep the stream in sync, then decline
+    char offer[sizeof(struct shm_offer_t)];
+    int reply = -1;
+    if (length == sizeof(offer))
+        recvall(socket_fd, offer, length, 0);
+    sendall(socket_fd, &reply, sizeof(reply), 0);
+    return NULL;
+}
+
+void
+shm_close(struct shm_channel_t *channel)
+{
+}
+
+void
+shm_push(struct shm_ring_t *ring, struct shm_message_t *message)
+{
+}
+
+int
+shm_pop(struct shm_ring_t *ring, struct shm_message_t *message, int socket_fd)
+{
+    return -1;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SHM_RING_SIZE 8
+
+struct shm_message_t
+{
+    enum command_t command;
+    bool found;
+    struct task_t task;
+};
+
+// Single-producer single-consumer ring, the consumer sleeps on tail
+struct shm_ring_t
+{
+    uint32_t head CACHE_ALIGNED;
+    uint32_t tail CACHE_ALIGNED;
+    uint32_t waiting;
+    struct shm_message_t slots[SHM_RING_SIZE] CACHE_ALIGNED;
+};
+
+struct shm_channel_t
+{
+    uint64_t magic, nonce;
+    struct shm_ring_t requests, responses;
+};
+
+struct shm_offer_t
+{
+    char name[64];
+    uint64_t nonce;
+};
+
+struct shm_channel_t *
+shm_offer(int socket_fd);
+
+struct shm_channel_t *
+shm_accept(int socket_fd, int length);
+
+void
+shm_close(struct shm_channel_t *);
+
+void
+shm_push(struct shm_ring_t *, struct shm_message_t *);
+
+int
+shm_pop(struct shm_ring_t *, struct shm_message_t *, int socket_fd);
+
+#endif // SHM_H
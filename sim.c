@@ -0,0 +1,751 @@
+#include "sim.h"
+#include "common.h"
+#include "jobs.h"
+#include "sched.h"
+#include "queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+// Tasks a producer keeps queued per job, as many as a real job queue holds
+#define SIM_QUEUE_SIZE ((int) (sizeof(((struct queue_t *) 0)->tasks) \
+                               / sizeof(struct task_t)))
+
+enum sim_chunk_t
+{
+    // Tasks of alphabet^level candidates, like the server's split
+    SC_FIXED,
+    // Half of the remaining work per client, at least alphabet^level,
+    // carved off when a client asks for it
+    SC_GUIDED,
+};
+
+enum sim_dispatch_t
+{
+    // The server's own policy: strict priority and weighted-fair sharing
+    SD_PRIORITY,
+    SD_FIFO,
+    SD_ROUND_ROBIN,
+};
+
+enum sim_event_type_t
+{
+    SE_JOIN,
+    SE_DONE,
+    SE_FAIL,
+    SE_LEAVE,
+    // An idle client looks for a straggler to copy again
+    SE_WAKE,
+};
+
+struct sim_event_t
+{
+    double time;
+    long long seq;
+    enum sim_event_type_t type;
+    int client;
+    unsigned generation;
+    // Task the client ran when a DONE or FAIL was scheduled
+    long long flight;
+};
+
+struct sim_client_t
+{
+    // Candidates per second, seconds of round trip per task, join and
+    // leave times, chance of failing a task and delay until rejoining
+    double rate, latency, join, leave, fail, rejoin;
+    bool online, busy;
+    // Events scheduled before the last leave or failure are stale
+    unsigned generation;
+    int job;
+    double task, started, online_since, idle_since;
+    double online_time, busy_time;
+    // Counts the client's tasks, cancelling one makes its events stale
+    long long flight;
+    // Copies share a spec like on the server, a cancelled copy only
+    // waits for the cancellation to reach it
+    struct sched_spec_t *spec;
+    bool copy, cancelled;
+    // Candidates per second of rate_job as the server measures them,
+    // latency included
+    double measured;
+    int rate_job;
+};
+
+struct sim_job_t
+{
+    // The ring holds sched.queued tasks
+    struct sched_job_t sched;
+    double total, produced;
+    // Ring of task sizes, failed tasks are queued again at the back
+    double *queue;
+    int head, capacity;
+    int running, losers;
+    int level;
+    bool complete;
+    double finished;
+};
+
+struct sim_t
+{
+    enum sim_chunk_t chunk;
+    int level;
+    enum sim_dispatch_t dispatch;
+    bool speculate;
+    int last_job;
+    uint64_t rng;
+
+    struct sim_client_t *clients;
+    int client_count, online;
+    struct sim_job_t *jobs;
+    struct sched_job_t **sched;
+    int job_count, jobs_left;
+
+    // Binary min-heap on (time, seq)
+    struct sim_event_t *events;
+    int event_count, event_capacity;
+    long long seq;
+
+    double now, drained, tail_idle, lost, cancelled;
+    long long tasks, requeued, speculated, copies_first;
+};
+
+static double
+sim_random(struct sim_t *sim)
+{
+    // xorshift64*, only the top 53 bits are used
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return ((sim->rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static bool
+sim_event_before(struct sim_event_t *a, struct sim_event_t *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void
+sim_schedule(struct sim_t *sim, double time, enum sim_event_type_t type, int client)
+{
+    if (sim->event_count == sim->event_capacity)
+    {
+        sim->event_capacity = (sim->event_capacity == 0) ? 64 : sim->event_capacity * 2;
+        sim->events = realloc(sim->events, sim->event_capacity * sizeof(struct sim_event_t));
+        if (sim->events == NULL)
+            handle_error("Couldn't reallocate space for events");
+    }
+    struct sim_event_t event = {
+        time, sim->seq++, type, client, sim->clients[client].generation,
+        sim->clients[client].flight
+    };
+    int i = sim->event_count++;
+    while (i > 0 && sim_event_before(&event, &sim->events[(i - 1) / 2]))
+    {
+        sim->events[i] = sim->events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim->events[i] = event;
+}
+
+static struct sim_event_t
+sim_next_event(struct sim_t *sim)
+{
+    struct sim_event_t top = sim->events[0];
+    struct sim_event_t last = sim->events[--sim->event_count];
+    int i = 0;
+    while (true)
+    {
+        int child = 2 * i + 1;
+        if (child >= sim->event_count)
+            break;
+        if (child + 1 < sim->event_count
+            && sim_event_before(&sim->events[child + 1], &sim->events[child]))
+            ++child;
+        if (!sim_event_before(&sim->events[child], &last))
+            break;
+        sim->events[i] = sim->events[child];
+        i = child;
+    }
+    sim->events[i] = last;
+    return top;
+}
+
+static void
+sim_queue_push(struct sim_job_t *job, double size)
+{
+    if (job->sched.queued == job->capacity)
+    {
+        int capacity = job->capacity * 2;
+        double *queue = malloc(capacity * sizeof(double));
+        if (queue == NULL)
+            handle_error("Couldn't allocate space for the task queue");
+        for (int i = 0; i < job->sched.queued; ++i)
+            queue[i] = job->queue[(job->head + i) % job->capacity];
+        free(job->queue);
+        job->queue = queue;
+        job->head = 0;
+        job->capacity = capacity;
+    }
+    job->queue[(job->head + job->sched.queued++) % job->capacity] = size;
+}
+
+// Keeps the queue as full as a producer thread would, guided tasks are
+// only sized once they are needed
+static void
+sim_produce(struct sim_t *sim, struct sim_job_t *job)
+{
+    double alph_size = strlen(job->sched.job->desc.alphabet);
+    int queued = (sim->chunk == SC_GUIDED) ? 1 : SIM_QUEUE_SIZE;
+    while (job->sched.queued < queued && job->produced < job->total)
+    {
+        double size = pow(alph_size, job->level);
+        if (sim->chunk == SC_GUIDED)
+        {
+            double share = floor((job->total - job->produced) / (2.0 * sim->client_count));
+            if (share > size)
+                size = share;
+        }
+        if (size > job->total - job->produced)
+            size = job->total - job->produced;
+        job->produced += size;
+        sim_queue_push(job, size);
+    }
+}
+
+// Takes the job of the next task off the queues, NULL with nothing queued
+static struct sim_job_t *
+sim_pick_job(struct sim_t *sim)
+{
+    for (int i = 0; i < sim->job_count; ++i)
+        sim_produce(sim, &sim->jobs[i]);
+    if (sim->dispatch == SD_PRIORITY)
+    {
+        int index = sched_next_job(sim->sched, sim->job_count);
+        return (index >= 0) ? &sim->jobs[index] : NULL;
+    }
+
+    for (int n = 0; n < sim->job_count; ++n)
+    {
+        int i = n;
+        if (sim->dispatch == SD_ROUND_ROBIN)
+            i = (sim->last_job + 1 + n) % sim->job_count;
+        if (sim->jobs[i].sched.queued > 0)
+        {
+            sched_take(&sim->jobs[i].sched);
+            return &sim->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+static void
+sim_idle_end(struct sim_t *sim, struct sim_client_t *client)
+{
+    if (sim->drained >= 0)
+    {
+        double from = (client->idle_since > sim->drained) ? client->idle_since : sim->drained;
+        if (sim->now > from)
+            sim->tail_idle += sim->now - from;
+    }
+}
+
+// Candidates of the client's task done by now
+static double
+sim_computed(struct sim_t *sim, struct sim_client_t *client)
+{
+    double elapsed = sim->now - client->started - client->latency;
+    if (elapsed <= 0)
+        return 0;
+    return (elapsed * client->rate < client->task) ? elapsed * client->rate : client->task;
+}
+
+static double
+sim_rate(struct sim_client_t *client, int job)
+{
+    return (client->rate_job == job) ? client->measured : 0;
+}
+
+static void
+sim_run(struct sim_t *sim, int index, int job, double size, struct sched_spec_t *spec)
+{
+    struct sim_client_t *client = &sim->clients[index];
+    sim_idle_end(sim, client);
+    client->busy = true;
+    client->job = job;
+    client->task = size;
+    client->started = sim->now;
+    client->spec = spec;
+    client->copy = (spec != NULL);
+    client->cancelled = false;
+    ++client->flight;
+
+    double duration = client->latency + client->task / client->rate;
+    if (client->fail > 0 && sim_random(sim) < client->fail)
+        sim_schedule(sim, sim->now + sim_random(sim) * duration, SE_FAIL, index);
+    else
+        sim_schedule(sim, sim->now + duration, SE_DONE, index);
+}
+
+// Like srv_speculate: with nothing queued, an idle client copies the
+// oldest task of a completely split job if the coordinator's policy
+// expects it to finish first, otherwise it looks again once it could
+static bool
+sim_speculate(struct sim_t *sim, int index)
+{
+    struct sim_client_t *self = &sim->clients[index];
+    struct sim_client_t *oldest = NULL;
+    double wait = HUGE_VAL;
+    for (int i = 0; i < sim->client_count; ++i)
+    {
+        struct sim_client_t *client = &sim->clients[i];
+        if (i == index || !client->busy || client->spec != NULL
+            || sim->jobs[client->job].produced < sim->jobs[client->job].total)
+            continue;
+        double until = sched_copy_wait(client->task, sim->now - client->started,
+                                       sim_rate(client, client->job),
+                                       sim_rate(self, client->job));
+        if (until > 0)
+        {
+            if (until < wait)
+                wait = until;
+        }
+        else if (oldest == NULL || client->started < oldest->started)
+            oldest = client;
+    }
+    if (oldest == NULL)
+    {
+        // Rounding must not leave the clock where it is
+        if (!isinf(wait))
+            sim_schedule(sim, sim->now + ((wait > 1e-9) ? wait : 1e-9), SE_WAKE, index);
+        return false;
+    }
+
+    struct sched_spec_t *spec = malloc(sizeof(struct sched_spec_t));
+    if (spec == NULL)
+        handle_error("Couldn't allocate space for a copied task");
+    spec->copies = 2;
+    spec->done = false;
+    oldest->spec = spec;
+    sim_run(sim, index, oldest->job, oldest->task, spec);
+    ++sim->speculated;
+    return true;
+}
+
+static void
+sim_dispatch(struct sim_t *sim, int index)
+{
+    struct sim_job_t *job = sim_pick_job(sim);
+    if (job == NULL)
+    {
+        // The first client without work marks the start of the tail
+        if (sim->drained < 0)
+            sim->drained = sim->now;
+        if (sim->speculate)
+            sim_speculate(sim, index);
+        return;
+    }
+
+    double size = job->queue[job->head];
+    job->head = (job->head + 1) % job->capacity;
+    ++job->running;
+    ++sim->tasks;
+    sim->last_job = job - sim->jobs;
+    sim_run(sim, index, job - sim->jobs, size, NULL);
+}
+
+static void
+sim_dispatch_idle(struct sim_t *sim)
+{
+    for (int i = 0; i < sim->client_count; ++i)
+    {
+        if (sim->clients[i].online && !sim->clients[i].busy)
+            sim_dispatch(sim, i);
+    }
+}
+
+static void
+sim_job_check(struct sim_t *sim, struct sim_job_t *job)
+{
+    if (job->complete || job->running != 0 || job->sched.queued != 0
+        || job->produced < job->total)
+        return;
+    job->complete = true;
+    job->finished = sim->now;
+    --sim->jobs_left;
+}
+
+// Called once a copy finished first, the other one is told to stop and
+// is done as soon as that reached it and its answer came back
+static void
+sim_cancel(struct sim_t *sim, struct sched_spec_t *spec)
+{
+    for (int i = 0; i < sim->client_count; ++i)
+    {
+        struct sim_client_t *client = &sim->clients[i];
+        if (!client->busy || client->spec != spec)
+            continue;
+        double computed = sim_computed(sim, client);
+        sim->cancelled += computed;
+        client->busy_time += computed / client->rate;
+        client->cancelled = true;
+        ++client->flight;
+        sim_schedule(sim, sim->now + client->latency, SE_DONE, i);
+    }
+}
+
+static void
+sim_done(struct sim_t *sim, struct sim_client_t *client)
+{
+    struct sim_job_t *job = &sim->jobs[client->job];
+    client->busy = false;
+    client->idle_since = sim->now;
+    if (!client->cancelled)
+    {
+        client->busy_time += client->task / client->rate;
+        client->measured = sched_rate(sim_rate(client, client->job), client->task,
+                                      sim->now - client->started);
+        client->rate_job = client->job;
+    }
+
+    struct sched_spec_t *spec = client->spec;
+    client->spec = NULL;
+    bool others = (spec != NULL && spec->copies > 1);
+    bool first = sched_spec_release(spec, true, &job->losers);
+    if (first && others)
+        sim_cancel(sim, spec);
+    if (first && client->copy)
+        ++sim->copies_first;
+    if (first)
+    {
+        --job->running;
+        sim_job_check(sim, job);
+    }
+}
+
+// The task goes back to its job's queue like after a dropped connection,
+// unless another copy of it is still running or already finished
+static void
+sim_drop(struct sim_t *sim, struct sim_client_t *client)
+{
+    struct sim_job_t *job = &sim->jobs[client->job];
+    if (!client->cancelled)
+        sim->lost += sim_computed(sim, client);
+    bool requeue = sched_requeue(client->spec);
+    sched_spec_release(client->spec, false, &job->losers);
+    client->spec = NULL;
+    if (requeue)
+    {
+        --job->running;
+        sim_queue_push(job, client->task);
+        ++sim->requeued;
+    }
+    client->busy = false;
+}
+
+static void
+sim_go_offline(struct sim_t *sim, struct sim_client_t *client)
+{
+    if (!client->busy)
+        sim_idle_end(sim, client);
+    client->online = false;
+    client->online_time += sim->now - client->online_since;
+    ++client->generation;
+    --sim->online;
+}
+
+static void
+sim_event(struct sim_t *sim, struct sim_event_t *event)
+{
+    struct sim_client_t *client = &sim->clients[event->client];
+    switch (event->type)
+    {
+    case SE_JOIN:
+        client->online = true;
+        client->busy = false;
+        client->online_since = sim->now;
+        client->idle_since = sim->now;
+        ++sim->online;
+        if (client->leave >= 0)
+            sim_schedule(sim, (client->leave > sim->now) ? client->leave : sim->now,
+                         SE_LEAVE, event->client);
+        sim_dispatch(sim, event->client);
+        break;
+    case SE_DONE:
+        sim_done(sim, client);
+        sim_dispatch(sim, event->client);
+        break;
+    case SE_WAKE:
+        if (client->online && !client->busy)
+            sim_dispatch(sim, event->client);
+        break;
+    case SE_FAIL:
+        sim_drop(sim, client);
+        sim_go_offline(sim, client);
+        if (client->rejoin >= 0)
+            sim_schedule(sim, sim->now + client->rejoin, SE_JOIN, event->client);
+        sim_dispatch_idle(sim);
+        break;
+    case SE_LEAVE:
+        if (client->busy)
+            sim_drop(sim, client);
+        sim_go_offline(sim, client);
+        // Leaving is for good, a later rejoin would be stale
+        client->rejoin = -1;
+        sim_dispatch_idle(sim);
+        break;
+    }
+}
+
+static double
+sim_number(const char *value, int line)
+{
+    char *end;
+    double number = strtod(value, &end);
+    if (*end != '\0' || number < 0)
+    {
+        fprintf(stderr, "Simulation line %d: bad number '%s'\n", line, value);
+        exit(EXIT_FAILURE);
+    }
+    return number;
+}
+
+static void
+sim_add_clients(struct sim_t *sim, char **fields, int count, int line)
+{
+    if (count < 3 || count % 2 == 0)
+    {
+        fprintf(stderr, "Simulation line %d: expected client COUNT RATE [key value]...\n", line);
+        exit(EXIT_FAILURE);
+    }
+    struct sim_client_t client = {
+        .rate = sim_number(fields[2], line),
+        .latency = 0, .join = 0, .leave = -1, .fail = 0, .rejoin = -1,
+        .rate_job = -1,
+    };
+    for (int i = 3; i < count; i += 2)
+    {
+        double value = sim_number(fields[i + 1], line);
+        if (strcmp(fields[i], "latency") == 0)
+            client.latency = value / 1000;
+        else if (strcmp(fields[i], "join") == 0)
+            client.join = value;
+        else if (strcmp(fields[i], "leave") == 0)
+            client.leave = value;
+        else if (strcmp(fields[i], "fail") == 0)
+            client.fail = value;
+        else if (strcmp(fields[i], "rejoin") == 0)
+            client.rejoin = value;
+        else
+        {
+            fprintf(stderr, "Simulation line %d: unknown key '%s'\n", line, fields[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (client.rate <= 0)
+    {
+        fprintf(stderr, "Simulation line %d: rate must be positive\n", line);
+        exit(EXIT_FAILURE);
+    }
+
+    int n = (int) sim_number(fields[1], line);
+    sim->clients = realloc(sim->clients, (sim->client_count + n) * sizeof(struct sim_client_t));
+    if (sim->clients == NULL)
+        handle_error("Couldn't reallocate space for clients");
+    for (int i = 0; i < n; ++i)
+        sim->clients[sim->client_count++] = client;
+}
+
+// One setting per line:
+//   seed N
+//   chunk fixed|guided [LEVEL]
+//   dispatch priority|fifo|round-robin
+//   speculate on|off
+//   client COUNT RATE [latency MS] [join S] [leave S] [fail P] [rejoin S]
+static void
+sim_load(struct sim_t *sim, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        handle_error("fopen");
+
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        ++line_no;
+        char *fields[16];
+        int count = 0;
+        for (char *token = strtok(line, " \t\r\n");
+             token != NULL && token[0] != '#' && count < 16;
+             token = strtok(NULL, " \t\r\n"))
+        {
+            fields[count++] = token;
+        }
+        if (count == 0)
+            continue;
+
+        if (strcmp(fields[0], "client") == 0)
+            sim_add_clients(sim, fields, count, line_no);
+        else if (strcmp(fields[0], "seed") == 0 && count == 2)
+            sim->rng = strtoull(fields[1], NULL, 10) | 1;
+        else if (strcmp(fields[0], "chunk") == 0 && (count == 2 || count == 3)
+                 && (strcmp(fields[1], "fixed") == 0 || strcmp(fields[1], "guided") == 0))
+        {
+            sim->chunk = (strcmp(fields[1], "fixed") == 0) ? SC_FIXED : SC_GUIDED;
+            sim->level = (count == 3) ? (int) sim_number(fields[2], line_no) : -1;
+        }
+        else if (strcmp(fields[0], "dispatch") == 0 && count == 2
+                 && strcmp(fields[1], "priority") == 0)
+            sim->dispatch = SD_PRIORITY;
+        else if (strcmp(fields[0], "dispatch") == 0 && count == 2
+                 && strcmp(fields[1], "fifo") == 0)
+            sim->dispatch = SD_FIFO;
+        else if (strcmp(fields[0], "dispatch") == 0 && count == 2
+                 && strcmp(fields[1], "round-robin") == 0)
+            sim->dispatch = SD_ROUND_ROBIN;
+        else if (strcmp(fields[0], "speculate") == 0 && count == 2
+                 && (strcmp(fields[1], "on") == 0 || strcmp(fields[1], "off") == 0))
+            sim->speculate = (strcmp(fields[1], "on") == 0);
+        else
+        {
+            fprintf(stderr, "Simulation line %d: unknown setting '%s'\n", line_no, fields[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(file);
+
+    if (sim->client_count == 0)
+    {
+        fprintf(stderr, "Simulation without clients\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+sim_report(struct sim_t *sim)
+{
+    double makespan = sim->now;
+    double online = 0, busy = 0;
+    for (int i = 0; i < sim->client_count; ++i)
+    {
+        struct sim_client_t *client = &sim->clients[i];
+        if (client->online)
+        {
+            if (!client->busy)
+                sim_idle_end(sim, client);
+            client->online_time += makespan - client->online_since;
+        }
+        online += client->online_time;
+        busy += client->busy_time;
+    }
+    double tail = (sim->drained >= 0) ? makespan - sim->drained : 0;
+
+    printf("makespan     %.3f s%s\n", makespan,
+           (sim->jobs_left != 0) ? " (incomplete, no clients left)" : "");
+    printf("utilization  %.1f %%\n", (online > 0) ? 100 * busy / online : 0);
+    printf("tail         %.3f s, %.3f client-s idle\n", tail, sim->tail_idle);
+    printf("tasks        %lld dispatched, %lld requeued, %.0f candidates lost\n",
+           sim->tasks, sim->requeued, sim->lost);
+    printf("speculation  %lld copies, %lld finished first, %.0f candidates cancelled\n",
+           sim->speculated, sim->copies_first, sim->cancelled);
+    for (int i = 0; i < sim->job_count; ++i)
+    {
+        struct sim_job_t *job = &sim->jobs[i];
+        if (job->complete)
+            printf("job %-8d %.3f s  %s\n", i, job->finished, job->sched.job->desc.hash);
+        else
+            printf("job %-8d -  %s\n", i, job->sched.job->desc.hash);
+    }
+}
+
+bool
+run_simulation(struct task_t *task, struct config_t *config)
+{
+    struct sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.chunk = SC_FIXED;
+    sim.level = -1;
+    sim.dispatch = SD_PRIORITY;
+    // Like the server, which always speculates
+    sim.speculate = true;
+    sim.last_job = -1;
+    sim.rng = 1;
+    sim.drained = -1;
+    sim_load(&sim, config->sim_path);
+
+    // Without a job file the command line describes the only job
+    struct job_t single;
+    struct job_list_t single_list = { &single, 1 };
+    struct job_list_t *list = &single_list;
+    if (config->jobs_path != NULL)
+        list = jobs_load(config->jobs_path, config);
+    else
+        job_from_config(&single, 0, config);
+
+    sim.job_count = sim.jobs_left = list->count;
+    sim.jobs = calloc(list->count, sizeof(struct sim_job_t));
+    sim.sched = malloc(list->count * sizeof(struct sched_job_t *));
+    if (sim.jobs == NULL || sim.sched == NULL)
+        handle_error("Couldn't allocate space for simulated jobs");
+    for (int i = 0; i < list->count; ++i)
+    {
+        struct sim_job_t *job = &sim.jobs[i];
+        struct job_desc_t *desc = &list->jobs[i].desc;
+        if (desc->brute_mode != M_ITERATIVE && desc->brute_mode != M_RECURSIVE
+            && desc->brute_mode != M_REC_ITERATOR)
+        {
+            fprintf(stderr, "Only enumerated keyspaces can be simulated\n");
+            exit(EXIT_FAILURE);
+        }
+        job->sched.job = &list->jobs[i];
+        sim.sched[i] = &job->sched;
+        job->total = pow(strlen(desc->alphabet), desc->length);
+        // The server's split level unless the spec sets one
+        struct config_t job_config = *config;
+        job_apply(desc, &job_config);
+        job->level = sched_split_level(&job_config, desc->length);
+        if (sim.level >= 0)
+            job->level = (sim.level < desc->length) ? sim.level : desc->length;
+        job->capacity = SIM_QUEUE_SIZE;
+        job->queue = malloc(job->capacity * sizeof(double));
+        if (job->queue == NULL)
+            handle_error("Couldn't allocate space for the task queue");
+    }
+
+    for (int i = 0; i < sim.client_count; ++i)
+        sim_schedule(&sim, sim.clients[i].join, SE_JOIN, i);
+
+    while (sim.jobs_left != 0 && sim.event_count != 0)
+    {
+        struct sim_event_t event = sim_next_event(&sim);
+        struct sim_client_t *client = &sim.clients[event.client];
+        if (event.generation != client->generation
+            || ((event.type == SE_DONE || event.type == SE_FAIL)
+                && event.flight != client->flight))
+            continue;
+        sim.now = event.time;
+        sim_event(&sim, &event);
+    }
+    sim_report(&sim);
+
+    // Copies cancelled at the very end are still on their way
+    for (int i = 0; i < sim.client_count; ++i)
+        sched_spec_release(sim.clients[i].spec, false, &sim.jobs[sim.clients[i].job].losers);
+    for (int i = 0; i < sim.job_count; ++i)
+        free(sim.jobs[i].queue);
+    free(sim.jobs);
+    free(sim.sched);
+    free(sim.clients);
+    free(sim.events);
+    if (config->jobs_path != NULL)
+        jobs_free(list);
+    return false;
+}
@@ -0,0 +1,15 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+
+struct task_t;
+struct config_t;
+
+// Runs the server's jobs on a virtual fleet described by config->sim_path
+// and a virtual clock: no hashing, no sockets, same result for the same
+// seed. Prints makespan, utilization and tail idle time.
+bool
+run_simulation(struct task_t *, struct config_t *);
+
+#endif // SIM_H
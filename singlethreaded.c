@@ -2,49 +2,207 @@
 #include "common.h"
 #include "iterative.h"
 #include "recursive.h"
+#include "wordlist.h"
+#include "markov.h"
+#include "kernels.h"
+#include "perf.h"
+#include "arena.h"
+#include "bcrypt.h"
+#include "des.h"
 
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
 bool
 st_password_handler(void *context, struct task_t *task)
 {
     struct st_context_t *ctx = (struct st_context_t *) context;
-    char *hashed = crypt_r(task->password, ctx->hash, &ctx->cd);
+    if (ctx->stop != NULL && *ctx->stop)
+        return true;
+    if (bcrypt_hash(ctx->hash))
+        return bcrypt_handler(ctx, task);
+    if (des_hash(ctx->hash))
+        return des_handler(ctx, task);
+    char *hashed = crypt_r(task->password, ctx->hash, ctx->cd);
     return (strcmp(hashed, ctx->hash) == 0);
 }
 
+struct st_split_context_t
+{
+    struct st_context_t st_context;
+    struct config_t *config;
+};
+
+static bool
+st_split_handler(void *context, struct task_t *task)
+{
+    struct st_split_context_t *ctx = (struct st_split_context_t *) context;
+    struct task_t subtask = *task;
+    subtask.to = subtask.from;
+    subtask.from = 0;
+    if (!process_task(&subtask, ctx->config, &ctx->st_context, st_password_handler))
+        return false;
+    memcpy(task->password, subtask.password, sizeof(subtask.password));
+    return true;
+}
+
 bool
 singlethreaded(struct task_t *task, struct config_t *config)
 {
-    struct st_context_t context;
-    context.hash = config->hash;
-    context.cd.initialized = 0;
+    struct arena_t arena;
+    if (arena_init(&arena, sizeof(struct crypt_data), 1) == -1)
+        handle_error("mmap");
+
+    struct st_split_context_t context;
+    context.st_context.hash = config->hash;
+    context.st_context.cd = arena_slot(&arena, 0);
+    context.st_context.stop = NULL;
+    context.config = config;
 
+    bool found;
     task->from = 0;
     task->to = config->length;
+    if (config->shard_count == 1)
+    {
+        found = process_task(task, config, &context.st_context, st_password_handler);
+    }
+    else
+    {
+        // A shard only sees part of the tasks, so split like the other modes
+        task->from = split_point(config);
+        found = split_task(task, config, &context, st_split_handler);
+    }
 
-    return process_task(task, config, &context, st_password_handler);
+    arena_destroy(&arena);
+    return found;
 }
 
-bool
-process_task(struct task_t *task,
-             struct config_t *config,
-             void *context,
-             password_handler_t handler)
+static bool
+run_task(struct task_t *task,
+         struct config_t *config,
+         void *context,
+         password_handler_t handler)
 {
     bool found = false;
     switch (config->brute_mode)
     {
     case M_ITERATIVE:
-        found = bruteforce_iter(task, config, context, handler);
+    {
+        enumerator_kernel_t kernel = kernel_select(task, config);
+        if (kernel != NULL)
+            found = kernel(task, config, context, handler);
+        else
+            found = bruteforce_iter(task, config, context, handler);
         break;
+    }
     case M_RECURSIVE:
         found = bruteforce_rec(task, config, context, handler);
         break;
     case M_REC_ITERATOR:
         found = bruteforce_rec_iter(task, config, context, handler);
         break;
+    case M_WORDLIST:
+    case M_HYBRID:
+    case M_HYBRID_PREFIX:
+        found = bruteforce_wordlist(task, config, context, handler);
+        break;
+    case M_MARKOV:
+        found = bruteforce_markov(task, config, context, handler);
+        break;
     }
     return found;
 }
+
+struct perf_context_t
+{
+    void *context;
+    password_handler_t handler;
+    uint64_t candidates;
+};
+
+static bool
+perf_handler(void *context, struct task_t *task)
+{
+    struct perf_context_t *ctx = (struct perf_context_t *) context;
+    ++ctx->candidates;
+    return ctx->handler(ctx->context, task);
+}
+
+bool
+process_task(struct task_t *task,
+             struct config_t *config,
+             void *context,
+             password_handler_t handler)
+{
+    if (task->from != 0)
+        return run_task(task, config, context, handler);
+
+    // Only leaf tasks are measured, splitting levels would count twice
+    if (!perf_enabled)
+        return bcrypt_flush(run_task(task, config, context, handler),
+                            context, handler, task);
+
+    struct perf_context_t perf_context = {
+        .context = context,
+        .handler = handler,
+        .candidates = 0,
+    };
+    struct perf_sample_t sample;
+    perf_begin(&sample);
+    bool found = run_task(task, config, &perf_context, perf_handler);
+    found = bcrypt_flush(found, context, handler, task);
+    const char *name = "custom";
+    if (handler == st_password_handler)
+    {
+        struct st_context_t *st_context = (struct st_context_t *) context;
+        if (bcrypt_hash(st_context->hash))
+            name = bcrypt_engine_name();
+        else if (des_hash(st_context->hash))
+            name = des_engine_name();
+        else
+            name = "crypt_r";
+    }
+    perf_end(&sample, config->brute_mode, name, perf_context.candidates);
+    return found;
+}
+
+struct shard_context_t
+{
+    void *context;
+    password_handler_t handler;
+    struct config_t *config;
+    long long seq;
+};
+
+static bool
+shard_handler(void *context, struct task_t *task)
+{
+    struct shard_context_t *ctx = (struct shard_context_t *) context;
+    if (!shard_owns(ctx->config, ctx->seq++))
+        return false;
+    return ctx->handler(ctx->context, task);
+}
+
+// Top-level split of the keyspace into tasks, restricted to this shard
+bool
+split_task(struct task_t *task,
+           struct config_t *config,
+           void *context,
+           password_handler_t handler)
+{
+    if (config->shard_count == 1)
+        return process_task(task, config, context, handler);
+
+    struct shard_context_t shard_context = {
+        .context = context,
+        .handler = handler,
+        .config = config,
+        .seq = 0,
+    };
+    return process_task(task, config, &shard_context, shard_handler);
+}
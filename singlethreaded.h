@@ -9,10 +9,15 @@
 struct task_t;
 struct config_t;
 
+// cd points into an arena_t, so hashing state of different threads
+// never shares cache lines and stays off the worker's stack
 struct st_context_t
 {
     char *hash;
-    struct crypt_data cd;
+    struct crypt_data *cd;
+    // Handlers pretend to have found the password once it is set, to cut
+    // the task short. NULL if nobody stops it.
+    const volatile bool *stop;
 };
 
 bool
@@ -24,4 +29,7 @@ singlethreaded(struct task_t *, struct config_t *);
 bool
 process_task(struct task_t *, struct config_t *, void *context, password_handler_t handler);
 
+bool
+split_task(struct task_t *, struct config_t *, void *context, password_handler_t handler);
+
 #endif // SINGLETHREADED_H
@@ -0,0 +1,246 @@
+#include "stream.h"
+
+#include "singlethreaded.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+enum slot_state_t
+{
+    S_EMPTY,
+    S_PENDING,
+    S_READY,
+};
+
+// Output of one task, task number seq lives in slot seq % slot_count
+struct slot_t
+{
+    struct task_t task;
+    enum slot_state_t state;
+    char *data;
+    size_t size, capacity;
+    // Candidate length if fixed by the mode, -1 otherwise
+    int length;
+};
+
+struct sm_context_t
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond, ready_cond;
+
+    struct slot_t *slots;
+    int slot_count;
+    // Tasks split so far, taken by workers and written out, in this order
+    long long produced, taken, flushed;
+    bool done;
+
+    struct config_t *config;
+};
+
+static bool
+sm_password_handler(void *context, struct task_t *task)
+{
+    struct slot_t *slot = (struct slot_t *) context;
+    size_t length = (slot->length >= 0) ? slot->length : strlen(task->password);
+    // A whole password is copied, constant-size copies are inlined
+    if (slot->size + PASSWORD_SIZE + 1 > slot->capacity)
+    {
+        slot->capacity *= 2;
+        slot->data = realloc(slot->data, slot->capacity);
+        if (slot->data == NULL)
+            handle_error("Couldn't reallocate space for stream buffer");
+    }
+    memcpy(slot->data + slot->size, task->password, PASSWORD_SIZE);
+    slot->data[slot->size + length] = '\n';
+    slot->size += length + 1;
+    return false;
+}
+
+static void *
+sm_worker(void *arg)
+{
+    struct sm_context_t *context = (struct sm_context_t *) arg;
+
+    pthread_mutex_lock(&context->mutex);
+    while (true)
+    {
+        if (context->taken == context->produced)
+        {
+            if (context->done)
+                break;
+            pthread_cond_wait(&context->work_cond, &context->mutex);
+            continue;
+        }
+        struct slot_t *slot = &context->slots[context->taken++ % context->slot_count];
+        pthread_mutex_unlock(&context->mutex);
+
+        struct task_t task = slot->task;
+        task.to = task.from;
+        task.from = 0;
+        process_task(&task, context->config, slot, sm_password_handler);
+
+        pthread_mutex_lock(&context->mutex);
+        slot->state = S_READY;
+        pthread_cond_signal(&context->ready_cond);
+    }
+    pthread_mutex_unlock(&context->mutex);
+    return NULL;
+}
+
+static void
+sm_write(struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if (written == -1)
+            handle_error("writev");
+        // Skip what went out, partial writes end inside some buffer
+        for (; count > 0 && (size_t) written >= iov->iov_len; ++iov, --count)
+            written -= iov->iov_len;
+        if (count > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+// Writes tasks out in split order up to, but excluding, limit. Every
+// ready task in a row goes out with a single writev.
+static void
+sm_flush(struct sm_context_t *context, long long limit)
+{
+    struct iovec iov[IOV_MAX];
+    while (context->flushed < limit)
+    {
+        pthread_mutex_lock(&context->mutex);
+        struct slot_t *slot = &context->slots[context->flushed % context->slot_count];
+        while (slot->state != S_READY)
+            pthread_cond_wait(&context->ready_cond, &context->mutex);
+        int count = 0;
+        for (long long seq = context->flushed;
+             seq < context->produced && count < IOV_MAX; ++seq, ++count)
+        {
+            slot = &context->slots[seq % context->slot_count];
+            if (slot->state != S_READY)
+                break;
+            iov[count].iov_base = slot->data;
+            iov[count].iov_len = slot->size;
+        }
+        pthread_mutex_unlock(&context->mutex);
+
+        sm_write(iov, count);
+
+        pthread_mutex_lock(&context->mutex);
+        for (int i = 0; i < count; ++i)
+            context->slots[(context->flushed + i) % context->slot_count].state = S_EMPTY;
+        context->flushed += count;
+        pthread_mutex_unlock(&context->mutex);
+    }
+}
+
+// The splitting thread doubles as the writer, a slot is only reused
+// once the task it held has been written
+static bool
+sm_split_handler(void *arg, struct task_t *task)
+{
+    struct sm_context_t *context = (struct sm_context_t *) arg;
+    long long seq = context->produced;
+    sm_flush(context, seq - context->slot_count + 1);
+
+    struct slot_t *slot = &context->slots[seq % context->slot_count];
+    slot->task = *task;
+    slot->size = 0;
+
+    pthread_mutex_lock(&context->mutex);
+    slot->state = S_PENDING;
+    ++context->produced;
+    pthread_cond_signal(&context->work_cond);
+    pthread_mutex_unlock(&context->mutex);
+    return false;
+}
+
+bool
+run_stdout(struct task_t *task, struct config_t *config)
+{
+    struct sm_context_t context;
+    pthread_mutex_init(&context.mutex, NULL);
+    pthread_cond_init(&context.work_cond, NULL);
+    pthread_cond_init(&context.ready_cond, NULL);
+    context.produced = context.taken = context.flushed = 0;
+    context.done = false;
+    context.config = config;
+
+    // Enumerated tasks cover as many trailing positions as it takes to
+    // fill a buffer, wordlist and Markov tasks are sized by their modes
+    int from = 1;
+    if (config->brute_mode == M_ITERATIVE || config->brute_mode == M_RECURSIVE
+        || config->brute_mode == M_REC_ITERATOR)
+    {
+        size_t alph_size = strlen(config->alphabet);
+        size_t size = alph_size * (config->length + 1);
+        for (; from < config->length - 1 && size < STREAM_TASK_SIZE; ++from)
+            size *= alph_size;
+    }
+
+    int worker_count = thread_count(config);
+    context.slot_count = 2 * worker_count;
+    context.slots = calloc(context.slot_count, sizeof(struct slot_t));
+    if (context.slots == NULL)
+        handle_error("Couldn't allocate space for stream slots");
+    for (int i = 0; i < context.slot_count; ++i)
+    {
+        context.slots[i].length = (config->brute_mode == M_ITERATIVE
+                                   || config->brute_mode == M_RECURSIVE
+                                   || config->brute_mode == M_REC_ITERATOR)
+            ? config->length : -1;
+        context.slots[i].capacity = STREAM_TASK_SIZE;
+        context.slots[i].data = malloc(STREAM_TASK_SIZE);
+        if (context.slots[i].data == NULL)
+            handle_error("Couldn't allocate space for stream buffer");
+    }
+
+    pthread_t workers[worker_count];
+    for (int i = 0; i < worker_count; ++i)
+    {
+        pthread_create(&workers[i], NULL, sm_worker, (void *) &context);
+    }
+
+    task->from = from;
+    task->to = config->length;
+    split_task(task, config, &context, sm_split_handler);
+
+    pthread_mutex_lock(&context.mutex);
+    context.done = true;
+    pthread_cond_broadcast(&context.work_cond);
+    pthread_mutex_unlock(&context.mutex);
+    sm_flush(&context, context.produced);
+
+    for (int i = 0; i < worker_count; ++i)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (int i = 0; i < context.slot_count; ++i)
+        free(context.slots[i].data);
+    free(context.slots);
+    pthread_mutex_destroy(&context.mutex);
+    pthread_cond_destroy(&context.work_cond);
+    pthread_cond_destroy(&context.ready_cond);
+
+    return false;
+}
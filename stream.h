@@ -0,0 +1,15 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+
+struct task_t;
+struct config_t;
+
+// Tasks are split to write about this much each
+#define STREAM_TASK_SIZE (1 << 20)
+
+bool
+run_stdout(struct task_t *, struct config_t *);
+
+#endif // STREAM_H
@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include "table.h"
+#include "common.h"
+#include "memcost.h"
+
+#include <crypt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+#define TABLE_MAGIC "BRTB"
+#define TABLE_VERSION 1
+
+struct table_header_t
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t length;
+    uint32_t alph_size;
+    char alphabet[256];
+    char setting[128];
+    uint64_t count;
+};
+
+struct tb_context_t
+{
+    struct table_header_t *header;
+    struct table_entry_t *entries;
+    uint64_t from, to;
+};
+
+// Salt part of a crypt(3) hash, everything before the digest
+static size_t
+table_setting_length(const char *hash)
+{
+    if (hash[0] != '$')
+        return (strlen(hash) < 2) ? strlen(hash) : 2;
+    return strrchr(hash, '$') - hash + 1;
+}
+
+// First 60 bits of the digest decoded from the crypt base64 alphabet
+static uint64_t
+table_key(const char *hash)
+{
+    static const char *b64 =
+        "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    const char *digest = hash + table_setting_length(hash);
+    uint64_t key = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        const char *c = (digest[i] != '\0') ? strchr(b64, digest[i]) : NULL;
+        key = (key << 6) | ((c != NULL) ? c - b64 : 0);
+        if (digest[i] == '\0') break;
+    }
+    return key;
+}
+
+// Candidate number index in the order of the iterative enumerator
+static void
+table_candidate(struct table_header_t *header, uint64_t index, char *password)
+{
+    for (int i = header->length - 1; i >= 0; --i)
+    {
+        password[i] = header->alphabet[index % header->alph_size];
+        index /= header->alph_size;
+    }
+    password[header->length] = '\0';
+}
+
+static void *
+tb_worker(void *arg)
+{
+    struct tb_context_t *context = (struct tb_context_t *) arg;
+    struct crypt_data *cd = calloc(1, sizeof(struct crypt_data));
+    if (cd == NULL)
+        handle_error("Couldn't allocate space for crypt_data");
+
+    password_t password;
+    for (uint64_t i = context->from; i < context->to; ++i)
+    {
+        table_candidate(context->header, i, password);
+        char *hashed = crypt_r(password, context->header->setting, cd);
+        context->entries[i].key = table_key(hashed);
+        context->entries[i].index = i;
+    }
+
+    free(cd);
+    return NULL;
+}
+
+static int
+table_compare(const void *a, const void *b)
+{
+    uint64_t x = ((const struct table_entry_t *) a)->key;
+    uint64_t y = ((const struct table_entry_t *) b)->key;
+    return (x > y) - (x < y);
+}
+
+void
+table_build(struct config_t *config)
+{
+    const char *path = config->table_path;
+    struct table_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_MAGIC, sizeof(header.magic));
+    header.version = TABLE_VERSION;
+    header.length = config->length;
+    header.alph_size = strlen(config->alphabet);
+
+    size_t setting = table_setting_length(config->hash);
+    if (header.alph_size >= sizeof(header.alphabet)
+        || setting >= sizeof(header.setting)
+        || header.alph_size == 0
+        || config->length >= PASSWORD_SIZE)
+    {
+        fprintf(stderr, "Unsupported table parameters\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(header.alphabet, config->alphabet, header.alph_size);
+    memcpy(header.setting, config->hash, setting);
+
+    header.count = 1;
+    for (int i = 0; i < config->length; ++i)
+    {
+        header.count *= header.alph_size;
+        if (header.count > TABLE_MAX_ENTRIES)
+        {
+            fprintf(stderr, "Keyspace is too big for a lookup table\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct table_entry_t *entries = malloc(header.count * sizeof(struct table_entry_t));
+    if (entries == NULL)
+        handle_error("Couldn't allocate space for table entries");
+
+    int cpu_count = memcost_threads(config, thread_count(config));
+    pthread_t threads[cpu_count];
+    struct tb_context_t contexts[cpu_count];
+    for (int i = 0; i < cpu_count; ++i)
+    {
+        contexts[i].header = &header;
+        contexts[i].entries = entries;
+        contexts[i].from = header.count * i / cpu_count;
+        contexts[i].to = header.count * (i + 1) / cpu_count;
+        pthread_create(&threads[i], NULL, tb_worker, (void *) &contexts[i]);
+    }
+    for (int i = 0; i < cpu_count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    qsort(entries, header.count, sizeof(struct table_entry_t), table_compare);
+
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        handle_error("fopen");
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(entries, sizeof(struct table_entry_t), header.count, out) != header.count)
+        handle_error("fwrite");
+    fclose(out);
+    free(entries);
+
+    fprintf(stderr, "Wrote %llu entries to %s\n",
+            (unsigned long long) header.count, path);
+}
+
+bool
+table_lookup(struct task_t *task, struct config_t *config)
+{
+    int fd = open(config->table_path, O_RDONLY);
+    if (fd == -1)
+        handle_error("open");
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        handle_error("fstat");
+    if (st.st_size < sizeof(struct table_header_t))
+    {
+        fprintf(stderr, "%s: not a lookup table\n", config->table_path);
+        exit(EXIT_FAILURE);
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        handle_error("mmap");
+    close(fd);
+    // Binary search jumps around the file
+    madvise(data, st.st_size, MADV_RANDOM);
+
+    struct table_header_t *header = (struct table_header_t *) data;
+    struct table_entry_t *entries = (struct table_entry_t *) (header + 1);
+    // The same limits as table_build, nothing else in the header is trusted
+    if (memcmp(header->magic, TABLE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != TABLE_VERSION
+        || header->alph_size == 0
+        || header->alph_size >= sizeof(header->alphabet)
+        || memchr(header->setting, '\0', sizeof(header->setting)) == NULL
+        || header->length >= PASSWORD_SIZE
+        || header->count > TABLE_MAX_ENTRIES
+        || st.st_size != sizeof(*header) + header->count * sizeof(*entries))
+    {
+        fprintf(stderr, "%s: not a lookup table\n", config->table_path);
+        exit(EXIT_FAILURE);
+    }
+
+    bool found = false;
+    size_t setting = table_setting_length(config->hash);
+    if (strlen(header->setting) != setting
+        || strncmp(header->setting, config->hash, setting) != 0)
+    {
+        fprintf(stderr, "Table was built for salt '%s'\n", header->setting);
+    }
+    else
+    {
+        uint64_t key = table_key(config->hash);
+        uint64_t lo = 0, hi = header->count;
+        while (lo < hi)
+        {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (entries[mid].key < key) lo = mid + 1;
+            else hi = mid;
+        }
+
+        // Digest prefixes may collide, confirm every match with crypt
+        struct crypt_data *cd = calloc(1, sizeof(struct crypt_data));
+        if (cd == NULL)
+            handle_error("Couldn't allocate space for crypt_data");
+        for (; !found && lo < header->count && entries[lo].key == key; ++lo)
+        {
+            table_candidate(header, entries[lo].index, task->password);
+            found = (strcmp(crypt_r(task->password, config->hash, cd), config->hash) == 0);
+        }
+        free(cd);
+    }
+
+    munmap(data, st.st_size);
+    return found;
+}
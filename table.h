@@ -0,0 +1,24 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Keyspaces above this aren't "small" and would need gigabytes of table
+#define TABLE_MAX_ENTRIES (1LL << 28)
+
+struct table_entry_t
+{
+    uint64_t key;
+    uint64_t index;
+};
+
+void
+table_build(struct config_t *);
+
+bool
+table_lookup(struct task_t *, struct config_t *);
+
+#endif // TABLE_H
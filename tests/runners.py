@@ -1,5 +1,9 @@
+import json
+import os
+import platform
 import subprocess as sb
-from time import time
+from pathlib import Path
+from time import time, perf_counter
 
 def run(command):
     return sb.run(command.split(), capture_output=True) \
@@ -11,6 +15,12 @@ def hash_password(password, salt="hi"):
     return run(f"./encr -p {password} -s {salt}")
 
 
+def hash_passwords(passwords, salt="hi"):
+    result = sb.run(["./encr", "-b", "-s", salt], capture_output=True,
+                    input="".join(f"{p}\n" for p in passwords).encode())
+    return result.stdout.decode().split()
+
+
 def performance_tester(f):
     base_length = 0
     tl_1 = 0
@@ -35,4 +45,78 @@ def performance_tester(f):
     r1 = tl_2 / tl_1
     r2 = tl_3 / tl_2
 
-    assert abs(r1 - r2) <= 1
\ No newline at end of file
+    assert abs(r1 - r2) <= 1
+
+BENCH_ALPHABET = "abcdefgh"
+BENCH_LENGTH = 5
+
+
+def throughput(run_mode, brute_mode, threads=0, repeats=3, salt="hi",
+               length=BENCH_LENGTH, options=""):
+    """Candidates per second of a full unsuccessful run, best of repeats"""
+    hashed = hash_password("q" * length, salt)
+    command = (f"./brute {run_mode} {brute_mode} -t {threads} {options} "
+               f"-a {BENCH_ALPHABET} -l {length} -h {hashed}")
+    best = float("inf")
+    for _ in range(repeats):
+        start = perf_counter()
+        assert run(command) == "Password not found"
+        best = min(best, perf_counter() - start)
+    return len(BENCH_ALPHABET) ** length / best
+
+
+def bench_host():
+    return {"machine": platform.machine(), "cpus": os.cpu_count()}
+
+
+def bench_export(section, results):
+    """Merges results into the JSON file named by BRUTE_BENCH_JSON"""
+    path = Path(os.environ.get("BRUTE_BENCH_JSON", "bench_results.json"))
+    data = json.loads(path.read_text()) if path.exists() else {}
+    data["host"] = bench_host()
+    data["time"] = time()
+    data[section] = results
+    path.write_text(json.dumps(data, indent=2, sort_keys=True) + "\n")
+
+
+def bench_check(results):
+    """Fails on throughput below the baseline in BRUTE_BENCH_BASELINE minus
+    the tolerance, BRUTE_BENCH_UPDATE=1 stores the results there instead.
+    Absolute numbers only compare on one host, so without a baseline
+    nothing is checked"""
+    path = os.environ.get("BRUTE_BENCH_BASELINE")
+    if path is None:
+        return
+    path = Path(path)
+    if os.environ.get("BRUTE_BENCH_UPDATE") == "1":
+        baseline = json.loads(path.read_text()) if path.exists() \
+            else {"throughput": {}, "tolerance": 0.2}
+        baseline["host"] = bench_host()
+        baseline["throughput"].update(
+            {key: round(value) for key, value in results.items()})
+        path.write_text(json.dumps(baseline, indent=2, sort_keys=True) + "\n")
+        return
+
+    baseline = json.loads(path.read_text())
+    assert baseline["host"] == bench_host(), \
+        f"baseline recorded on another host: {baseline['host']}"
+    tolerance = float(os.environ.get("BRUTE_BENCH_TOLERANCE",
+                                     baseline["tolerance"]))
+    regressions = {
+        key: (value, baseline["throughput"][key])
+        for key, value in results.items()
+        if key in baseline["throughput"]
+        and value < baseline["throughput"][key] * (1 - tolerance)
+    }
+    assert not regressions, f"throughput regressions: {regressions}"
+
+
+def thread_counts():
+    """1, 2, 4, ... up to and including the number of CPUs"""
+    cpus = os.cpu_count()
+    counts = [1]
+    while counts[-1] * 2 < cpus:
+        counts.append(counts[-1] * 2)
+    if counts[-1] != cpus:
+        counts.append(cpus)
+    return counts
@@ -1,4 +1,16 @@
-from runners import run, hash_password, performance_tester
+from runners import run, hash_password, hash_passwords, performance_tester
+from runners import throughput, thread_counts, bench_export, bench_check
+
+import ctypes
+import itertools
+import json
+import os
+import signal
+import socket
+import struct
+import subprocess as sb
+from pathlib import Path
+from time import sleep, monotonic
 
 
 def base_call(run_mode, brute_mode, alphabet="abc", is_found=True):
@@ -80,3 +92,908 @@ def test_multithreaded_performance():
 def test_generator_performance():
     for brute_mode in ["-i", "-r", "-y"]:
         performance_tester(base_call("-g", brute_mode, is_found=False))
+
+RUN_MODES = [("-s", "single"), ("-m", "multi"), ("-g", "generator")]
+BRUTE_MODES = [("-i", "iterative"), ("-r", "recursive"), ("-y", "rec-iterator")]
+
+def test_throughput_performance():
+    results = {
+        f"{run_name}/{brute_name}": throughput(run_mode, brute_mode)
+        for run_mode, run_name in RUN_MODES
+        for brute_mode, brute_name in BRUTE_MODES
+    }
+    bench_export("throughput", results)
+    bench_check(results)
+    # Holds on any host: the run modes share the hashing path, so none of
+    # them may fall far behind the fastest one
+    slow = {key: rate for key, rate in results.items()
+            if rate < 0.5 * max(results.values())}
+    assert not slow, f"run modes far behind the fastest one: {slow}"
+
+def test_scaling_performance():
+    # SMT siblings and busy hosts don't scale linearly, by default more
+    # threads only have to be faster than one
+    efficiency = os.environ.get("BRUTE_BENCH_EFFICIENCY")
+    results = {}
+    failures = []
+    for run_mode, run_name in RUN_MODES[1:]:
+        rates = {t: throughput(run_mode, "-i", threads=t) for t in thread_counts()}
+        results[run_name] = {
+            str(t): {"candidates_per_sec": rate, "speedup": rate / rates[1]}
+            for t, rate in rates.items()
+        }
+        failures += [
+            (run_name, t, rate / rates[1]) for t, rate in rates.items()
+            if t > 1 and (rate / rates[1] <= 1 if efficiency is None
+                          else rate / rates[1] < float(efficiency) * t)
+        ]
+    bench_export("scaling", results)
+    assert not failures, f"poor scaling (mode, threads, speedup): {failures}"
+
+BCRYPT_SALT = "$2b$04$abcdefghijklmnopqrstuu"
+BCRYPT_ENGINES = ["crypt", "lanes", "avx2", "auto"]
+
+def test_bcrypt_performance():
+    results = {
+        engine: throughput("-s", "-i", salt=BCRYPT_SALT, length=3,
+                           options=f"--bcrypt-engine {engine}")
+        for engine in BCRYPT_ENGINES
+    }
+    bench_export("bcrypt", results)
+
+DES_ENGINES = ["crypt", "incremental"]
+
+def test_des_performance():
+    results = {
+        engine: throughput("-s", "-i", options=f"--des-engine {engine}")
+        for engine in DES_ENGINES
+    }
+    bench_export("des", results)
+
+
+# Wordlist mode
+def wordlist_wrapper(tmp_path, words, password, found=True):
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("\n".join(words) + "\n")
+    hashed = hash_password(password, "hi")
+
+    for run_mode in ["-s", "-m", "-g"]:
+        result = run(f"./brute {run_mode} -w {wordlist} -h {hashed}")
+        if found:
+            assert result == f"Password found: '{password}'"
+        else:
+            assert result == f"Password not found"
+
+def test_wordlist(tmp_path):
+    wordlist_wrapper(tmp_path, ["apple", "hunter2", "zebra"], "hunter2")
+
+def test_wordlist_last(tmp_path):
+    wordlist_wrapper(tmp_path, ["apple", "hunter2", "zebra"], "zebra")
+
+def test_wordlist_notfound(tmp_path):
+    wordlist_wrapper(tmp_path, ["apple", "hunter2", "zebra"], "qwerty",
+                     found=False)
+
+
+# Hybrid mode
+def hybrid_wrapper(tmp_path, words, password, option="--hybrid", found=True):
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("\n".join(words) + "\n")
+    hashed = hash_password(password, "hi")
+
+    for run_mode in ["-s", "-m", "-g", "-x --reserve 0 -p 9404"]:
+        result = run(f"./brute {run_mode} {option} {wordlist} -a 0123456789 "
+                     f"-l 2 -h {hashed}")
+        if found:
+            assert result == f"Password found: '{password}'"
+        else:
+            assert result == f"Password not found"
+
+def test_hybrid(tmp_path):
+    hybrid_wrapper(tmp_path, ["apple", "hunter", "zebra"], "hunter42")
+
+def test_hybrid_prefix(tmp_path):
+    hybrid_wrapper(tmp_path, ["apple", "hunter", "zebra"], "99zebra",
+                   option="--hybrid-prefix")
+
+def test_hybrid_notfound(tmp_path):
+    hybrid_wrapper(tmp_path, ["apple", "hunter", "zebra"], "hunter4",
+                   found=False)
+
+def test_hybrid_shards(tmp_path):
+    # Enough words for several tasks, each shard gets whole words
+    words = [f"w{i:04d}" for i in range(2000)]
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("\n".join(words) + "\n")
+    shards = [
+        run(f"./brute --stdout --shard {i}/3 --hybrid {wordlist} "
+            f"-a 0123456789 -l 3").split()
+        for i in range(3)
+    ]
+    candidates = sorted(itertools.chain(*shards))
+    assert candidates == sorted(w + f"{n:03d}" for w in words for n in range(1000))
+    assert all(len(shard) < len(candidates) for shard in shards)
+
+
+# Mangling rules
+def rules_wrapper(tmp_path, rules, password, found=True):
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("apple\nhunter\nzebra\n")
+    rulefile = tmp_path / "rules.txt"
+    rulefile.write_text("\n".join(rules) + "\n")
+    hashed = hash_password(password, "hi")
+
+    for run_mode in ["-s", "-m", "-g"]:
+        result = run(
+            f"./brute {run_mode} -w {wordlist} -R {rulefile} -h {hashed}"
+        )
+        if found:
+            assert result == f"Password found: '{password}'"
+        else:
+            assert result == f"Password not found"
+
+def test_rules_transform(tmp_path):
+    rules = ["c", "$1 $2 $3", "sa4 se3", "r", "d", "^x u"]
+    for password in ["Hunter", "hunter123", "4ppl3", "retnuh",
+                     "zebrazebra", "XAPPLE"]:
+        rules_wrapper(tmp_path, rules, password)
+
+def test_rules_notfound(tmp_path):
+    rules_wrapper(tmp_path, ["c", "$1"], "hunter", found=False)
+
+def test_rules_reject(tmp_path):
+    # A rejected "$<tab>" must not leave its argument to be read as an opcode
+    word = "abcdefghijklmnopqrs"
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text(word + "\n")
+    rules = tmp_path / "rules.txt"
+    rules.write_text("$\t\nu\n:\n")
+    result = run(f"./brute --stdout -w {wordlist} -R {rules}").split()
+    assert result == [word.upper(), word]
+
+    result = sb.run(f"./brute --stdout -a abc -l 2 -R {rules}".split(),
+                    capture_output=True)
+    assert result.returncode != 0
+    assert result.stdout == b""
+
+
+# Markov mode
+def markov_wrapper(tmp_path, password, alphabet="abc", level=None, found=True):
+    corpus = tmp_path / "corpus.txt"
+    corpus.write_text("abca\nabcb\ncab\nbbac\naaab\n")
+    model = tmp_path / "model.bin"
+    run(f"./brute -M {model} --markov-train {corpus}")
+
+    length = len(password)
+    hashed = hash_password(password, "hi")
+    level = "" if level is None else f"--markov-level {level}"
+    for run_mode in ["-s", "-m", "-g"]:
+        result = run(
+            f"./brute {run_mode} -M {model} {level} "
+            f"-l {length} -h {hashed} -a {alphabet}"
+        )
+        if found:
+            assert result == f"Password found: '{password}'"
+        else:
+            assert result == f"Password not found"
+
+def test_markov(tmp_path):
+    markov_wrapper(tmp_path, "abca")
+
+def test_markov_unlikely(tmp_path):
+    markov_wrapper(tmp_path, "ccccccc")
+
+def test_markov_notfound(tmp_path):
+    markov_wrapper(tmp_path, "qaaa", found=False)
+
+def test_markov_level(tmp_path):
+    markov_wrapper(tmp_path, "ccccccc", level=0, found=False)
+
+
+# Sharding
+def shard_wrapper(password, shards=3, alphabet="abc"):
+    length = len(password)
+    hashed = hash_password(password, "hi")
+
+    for run_mode in ["-s", "-m", "-g"]:
+        for brute_mode in ["-i", "-r", "-y"]:
+            results = [
+                run(
+                    f"./brute {run_mode} {brute_mode} --shard {i}/{shards} "
+                    f"-l {length} -h {hashed} -a {alphabet}"
+                )
+                for i in range(shards)
+            ]
+            assert results.count(f"Password found: '{password}'") == 1
+            assert results.count("Password not found") == shards - 1
+
+def test_shard_first():
+    shard_wrapper("aaaaa")
+
+def test_shard():
+    shard_wrapper("cabca")
+
+def test_shard_last():
+    shard_wrapper("ccccc")
+
+def test_shard_wordlist(tmp_path):
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("apple\nhunter2\nzebra\n")
+    hashed = hash_password("zebra", "hi")
+    for run_mode in ["-s", "-m", "-g"]:
+        results = [
+            run(f"./brute {run_mode} --shard {i}/2 -w {wordlist} -h {hashed}")
+            for i in range(2)
+        ]
+        assert results.count("Password found: 'zebra'") == 1
+
+def test_shard_balance(tmp_path):
+    # Every shard gets about the same share of words and Markov candidates
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("".join(f"word{i}\n" for i in range(4)))
+    shards = [run(f"./brute --stdout --shard {i}/2 -w {wordlist}").split()
+              for i in range(2)]
+    assert shards == [["word0", "word1"], ["word2", "word3"]]
+
+    corpus = tmp_path / "corpus.txt"
+    corpus.write_text("abca\nabcb\ncab\nbbac\naaab\n")
+    model = tmp_path / "model.bin"
+    run(f"./brute -M {model} --markov-train {corpus}")
+    shards = [run(f"./brute --stdout --shard {i}/3 -M {model} -a abc -l 7").split()
+              for i in range(3)]
+    assert sorted(sum(shards, [])) == \
+        sorted("".join(p) for p in itertools.product("abc", repeat=7))
+    assert all(abs(len(shard) - 3 ** 7 / 3) < 3 ** 7 / 10 for shard in shards)
+
+
+# Lookup tables
+def test_table(tmp_path):
+    table = tmp_path / "table.bin"
+    hashed = hash_password("aaaa", "hi")
+    run(f"./brute --build-table {table} -l 4 -a abc -h {hashed}")
+    for password in ["aaaa", "bcab", "cccc"]:
+        hashed = hash_password(password, "hi")
+        result = run(f"./brute --table {table} -h {hashed}")
+        assert result == f"Password found: '{password}'"
+
+def test_table_corrupt(tmp_path):
+    table = tmp_path / "table.bin"
+    hashed = hash_password("aaaa", "hi")
+    run(f"./brute --build-table {table} -l 4 -a abc -h {hashed}")
+    data = table.read_bytes()
+    # Zero alphabet size, oversized alphabet, unterminated salt, long length
+    for offset, patch in [(12, b"\0\0\0\0"), (12, b"\xff\xff\0\0"),
+                          (272, b"x" * 128), (8, b"\xff\0\0\0")]:
+        table.write_bytes(data[:offset] + patch + data[offset + len(patch):])
+        result = sb.run(f"./brute --table {table} -h {hashed}".split(),
+                        capture_output=True, text=True)
+        assert result.returncode == 1
+        assert "not a lookup table" in result.stderr
+
+def test_table_notfound(tmp_path):
+    table = tmp_path / "table.bin"
+    hashed = hash_password("aaaa", "hi")
+    run(f"./brute --build-table {table} -l 4 -a abc -h {hashed}")
+    for password, salt in [("qaaa", "hi"), ("aaaa", "zz")]:
+        hashed = hash_password(password, salt)
+        result = run(f"./brute --table {table} -h {hashed}")
+        assert result == f"Password not found"
+
+
+# Potfile
+def test_potfile(tmp_path):
+    potfile = tmp_path / "brute.pot"
+    hashed = hash_password("cabcabc", "hi")
+    for run_mode in ["-s", "-m", "-g"]:
+        result = run(
+            f"./brute {run_mode} -l 7 -h {hashed} --potfile {potfile}"
+        )
+        assert result == "Password found: 'cabcabc'"
+    assert potfile.read_text() == f"{hashed}:cabcabc\n"
+
+    # Answered from the potfile even though the keyspace doesn't match
+    result = run(f"./brute -l 1 -a q -h {hashed} --potfile {potfile}")
+    assert result == "Password found: 'cabcabc'"
+
+def test_potfile_notfound(tmp_path):
+    potfile = tmp_path / "brute.pot"
+    hashed = hash_password("qaaa", "hi")
+    result = run(f"./brute -l 4 -h {hashed} --potfile {potfile}")
+    assert result == "Password not found"
+    assert not potfile.exists()
+
+
+# Server mode
+def test_server_local_workers():
+    for password, found in [("cabcabc", True), ("qabcabc", False)]:
+        hashed = hash_password(password, "hi")
+        result = run(f"./brute -x --reserve 0 -p 9401 -l 7 -h {hashed}")
+        if found:
+            assert result == f"Password found: '{password}'"
+        else:
+            assert result == f"Password not found"
+
+def test_server_client():
+    hashed = hash_password("bcabcab", "hi")
+    server = sb.Popen(
+        f"./brute -x -p 9402 -l 7 -h {hashed} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.DEVNULL
+    )
+    sleep(0.2)
+    run(f"./brute -c -p 9402 -l 7 -h {hashed}")
+    result = server.communicate(timeout=30)[0].decode().strip()
+    assert result == "Password found: 'bcabcab'"
+
+def test_server_shm():
+    # Clients on the server's address get tasks through shared memory
+    hashed = hash_password("bcab", "hi")
+    server = sb.Popen(
+        f"./brute -x -p 9412 -l 4 -h {hashed} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.PIPE
+    )
+    sleep(0.2)
+    client = run("./brute -c -p 9412")
+    out, err = server.communicate(timeout=30)
+    assert "Using shared memory transport" in client
+    assert "Using shared memory transport" in err.decode()
+    assert out.decode().strip() == "Password found: 'bcab'"
+
+def test_server_shm_fallback():
+    # Another local address looks like another host, tasks stay on the socket
+    hashed = hash_password("bcab", "hi")
+    server = sb.Popen(
+        f"./brute -x -p 9412 -l 4 -h {hashed} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.PIPE
+    )
+    sleep(0.2)
+    client = run("./brute -c -p 9412 -j 127.0.0.2")
+    out, err = server.communicate(timeout=30)
+    assert "Using shared memory transport" not in client
+    assert "Using shared memory transport" not in err.decode()
+    assert out.decode().strip() == "Password found: 'bcab'"
+
+def test_server_many_clients():
+    # More clients than the initial client set holds, all connecting at
+    # once while the accept thread hands sockets to their threads
+    hashed = hash_password("qqqqq", "hi")
+    server = sb.Popen(
+        f"./brute -x -p 9413 -l 5 -h {hashed} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.DEVNULL
+    )
+    sleep(0.2)
+    clients = [sb.Popen("./brute -c -p 9413".split(), stdout=sb.DEVNULL,
+                        stderr=sb.DEVNULL) for _ in range(8)]
+    try:
+        out = server.communicate(timeout=30)[0]
+        for client in clients:
+            client.wait(timeout=30)
+    finally:
+        for process in [server] + clients:
+            if process.poll() is None:
+                process.kill()
+    assert out.decode().strip() == "Password not found"
+
+def test_client_server_gone():
+    # A server closing mid-message is EOF for the client, not a retry
+    listener = socket.socket()
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", 9414))
+    listener.listen(1)
+    client = sb.Popen("./brute -c -p 9414".split(), stdout=sb.DEVNULL,
+                      stderr=sb.DEVNULL)
+    try:
+        connection, _ = listener.accept()
+        connection.sendall(b"\0\0")
+        connection.close()
+        client.wait(timeout=10)
+    finally:
+        if client.poll() is None:
+            client.kill()
+        listener.close()
+
+def test_server_stragglers():
+    # A stopped client never finishes its task, an idle one runs a copy
+    hashed = hash_password("AAAA", "hi")
+    server = sb.Popen(
+        f"./brute -x -p 9409 -a abcdefghijklmnopqrstuvwxyz -l 4 -h {hashed} "
+        "--reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.PIPE
+    )
+    sleep(0.2)
+    stalled = sb.Popen("./brute -c -p 9409".split(), stdout=sb.DEVNULL, stderr=sb.DEVNULL)
+    sleep(0.3)
+    stalled.send_signal(signal.SIGSTOP)
+    try:
+        run("./brute -c -p 9409")
+        out, err = server.communicate(timeout=30)
+    finally:
+        stalled.send_signal(signal.SIGCONT)
+        stalled.wait(timeout=30)
+    assert out.decode().strip() == "Password not found"
+    assert "Ran copies of 1 straggling tasks, 1 finished first, 1 losers cancelled" \
+        in err.decode()
+
+def test_client_cancel():
+    # A cancelled task stops early and is answered as not found
+    listener = socket.socket()
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", 9415))
+    listener.listen(1)
+    client = sb.Popen("./brute -c -p 9415".split(), stdout=sb.DEVNULL,
+                      stderr=sb.DEVNULL)
+    command = lambda tag, payload=b"": struct.pack("ii", tag, len(payload)) + payload
+    try:
+        connection, _ = listener.accept()
+        connection.settimeout(10)
+        receive = lambda: struct.unpack("i", connection.recv(4, socket.MSG_WAITALL))[0]
+        # CMD_JOB for 26^6 candidates, then CMD_TASK for all of them
+        desc = struct.pack("iii128s128s", 0, 6, 1, hash_password("zzzzzzz").encode(),
+                           b"abcdefghijklmnopqrstuvwxyz")
+        connection.sendall(command(4, desc))
+        assert receive() == 0
+        connection.sendall(command(2, struct.pack("20sii4xqq", b"", 0, 6, 0, 0)))
+        sleep(0.3)
+        start = monotonic()
+        connection.sendall(command(5))
+        assert receive() == 0
+        assert monotonic() - start < 5
+        # A late CMD_CANCEL is ignored before the next command
+        connection.sendall(command(5) + command(1))
+        client.wait(timeout=10)
+    finally:
+        if client.poll() is None:
+            client.kill()
+        listener.close()
+
+def relay_chain(server_args, relay_args, client="", with_client=True):
+    """Runs a server, a chain of relays below it and a client at the end,
+    returns the server's output"""
+    server = sb.Popen(
+        f"./brute -x -p 9405 --reserve 1024 {server_args}".split(),
+        stdout=sb.PIPE, stderr=sb.DEVNULL
+    )
+    relays = []
+    for i, args in enumerate(relay_args):
+        sleep(0.2)
+        relays.append(sb.Popen(
+            f"./brute --relay {9406 + i} -p {9405 + i} {args}".split(),
+            stdout=sb.DEVNULL, stderr=sb.DEVNULL
+        ))
+    sleep(0.2)
+    if with_client:
+        run(f"./brute -c -p {9405 + len(relays)} {client}")
+    result = server.communicate(timeout=30)[0].decode().strip()
+    for relay in relays:
+        relay.wait(timeout=30)
+    return result
+
+def test_relay_stragglers():
+    # Both clients wait in the relay before its first task is split, the
+    # idle one is woken up to copy the stopped one's task
+    hashed = hash_password("AAAA", "hi")
+    server = sb.Popen(
+        f"./brute -x -p 9410 -a abcdefghijklmnopqrstuvwxyz -l 4 --split 3 "
+        f"-h {hashed} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.DEVNULL
+    )
+    sleep(0.2)
+    relay = sb.Popen("./brute --relay 9411 -p 9410 --split 3 --reserve 1024".split(),
+                     stdout=sb.DEVNULL, stderr=sb.DEVNULL)
+    sleep(0.2)
+    clients = [sb.Popen("./brute -c -p 9411".split(), stdout=sb.DEVNULL, stderr=sb.DEVNULL)
+               for _ in range(2)]
+    sleep(0.5)
+    clients[0].send_signal(signal.SIGSTOP)
+    try:
+        out = server.communicate(timeout=30)[0]
+    finally:
+        clients[0].send_signal(signal.SIGCONT)
+        for process in [server, relay] + clients:
+            if process.poll() is None:
+                process.kill()
+            process.wait(timeout=30)
+    assert out.decode().strip() == "Password not found"
+
+def test_relay(tmp_path):
+    # The server's tasks are split twice on their way down to the client
+    for password, found in [("bcabca", True), ("qbcabc", False)]:
+        hashed = hash_password(password, "hi")
+        result = relay_chain(f"-l 6 --split 5 -h {hashed}",
+                             ["--split 3 --reserve 1024", "--reserve 1024"])
+        if found:
+            assert result == f"Password found: '{password}'"
+        else:
+            assert result == "Password not found"
+
+    # A relay's own workers take parts of the tasks too
+    hashed = hash_password("cabcab", "hi")
+    result = relay_chain(f"-l 6 --split 4 -h {hashed}", ["--reserve 0"], with_client=False)
+    assert result == "Password found: 'cabcab'"
+
+    # Wordlists are loaded at each level
+    words = tmp_path / "words.txt"
+    words.write_text("".join(f"w{i}\n" for i in range(100000)))
+    hashed = hash_password("w99999", "hi")
+    result = relay_chain(f"-w {words} -h {hashed}", [f"-w {words} --reserve 1024"],
+                         client=f"-w {words}")
+    assert result == "Password found: 'w99999'"
+
+    # Every job is passed down
+    jobs = tmp_path / "jobs.txt"
+    hashes = hash_passwords(["abcd", "zyx", "qqq"])
+    jobs.write_text(f"{hashes[0]} 4 abcd y\n{hashes[1]} 3 xyz r\n{hashes[2]} 3\n")
+    result = relay_chain(f"--jobs {jobs} --split 3",
+                         ["--split 1 --reserve 1024"]).splitlines()
+    assert sorted(result) == sorted([
+        f"{hashes[0]}: Password found: 'abcd'",
+        f"{hashes[1]}: Password found: 'zyx'",
+        f"{hashes[2]}: Password not found",
+    ])
+
+
+# Tracing
+def test_trace(tmp_path):
+    trace = tmp_path / "trace.json"
+    hashed = hash_password("qaaaa", "hi")
+    for run_mode in ["-m", "-g"]:
+        result = run(f"./brute {run_mode} -l 5 -h {hashed} --trace {trace}")
+        assert result == "Password not found"
+        events = json.loads(trace.read_text())["traceEvents"]
+        tasks = [e for e in events if e["ph"] == "X" and e["name"] == "task"]
+        assert len(tasks) == 3 ** 3
+
+
+def test_perf():
+    hashed = hash_password("qaaaa", "hi")
+    for run_mode in ["-s", "-m", "-g"]:
+        result = sb.run(
+            f"./brute {run_mode} -l 5 -h {hashed} --perf",
+            shell=True, capture_output=True, text=True,
+        )
+        assert result.stdout.strip() == "Password not found"
+        if "perf_event_open" in result.stderr:
+            continue
+        # Hardware counters may be missing, candidates are still accounted
+        rows = [line.split() for line in result.stderr.splitlines()]
+        rows = [row for row in rows if row[:2] == ["iterative", "des-incr"]]
+        assert len(rows) == 1 and rows[0][2] == str(3 ** 5)
+
+
+# bcrypt lanes
+def test_bcrypt(tmp_path):
+    # 8 candidates fill two scalar batches or one AVX2 batch
+    for salt in ["$2a$04$abcdefghijklmnopqrstuu", BCRYPT_SALT, "$2y$05$ABCDEFGHIJKLMNOPQRSTUu"]:
+        hashes = hash_passwords(["aaa", "bab", "bbb", "qqq"], salt)
+        for engine, run_mode in itertools.product(BCRYPT_ENGINES, ["-s", "-m", "-g"]):
+            for password, hashed in zip(["aaa", "bab", "bbb"], hashes):
+                assert run(f"./brute {run_mode} -a ab -l 3 --bcrypt-engine {engine} "
+                           f"-h {hashed}") == f"Password found: '{password}'"
+            assert run(f"./brute {run_mode} -a ab -l 3 --bcrypt-engine {engine} "
+                       f"-h {hashes[3]}") == "Password not found"
+
+    # A partial batch is checked at the end of the task
+    words = tmp_path / "words.txt"
+    words.write_text("one\ntwo\nthree\nfour\nfive\n")
+    hashed = hash_passwords(["five"], BCRYPT_SALT)[0]
+    for engine in BCRYPT_ENGINES:
+        assert run(f"./brute -s -w {words} --bcrypt-engine {engine} "
+                   f"-h {hashed}") == "Password found: 'five'"
+
+def test_bcrypt_dispatch():
+    # Without --bcrypt-engine the host's CPU features pick the engine
+    flags = Path("/proc/cpuinfo").read_text().split() \
+        if Path("/proc/cpuinfo").exists() else []
+    expected = "bcrypt-avx2" if "avx2" in flags else "bcrypt-lanes"
+    hashed = hash_passwords(["qqq"], BCRYPT_SALT)[0]
+    result = sb.run(["./brute", "-s", "-a", "ab", "-l", "3", "-h", hashed, "--perf"],
+                    capture_output=True, text=True)
+    assert result.stdout.strip() == "Password not found"
+    if "perf_event_open" not in result.stderr:
+        rows = [line.split()[:2] for line in result.stderr.splitlines()]
+        assert ["iterative", expected] in rows
+
+
+# Incremental DES
+def test_des(tmp_path):
+    # Salts with every bit set swap all 12 pairs of the expansion
+    for salt in ["hi", "..", "zz", "A9"]:
+        hashes = hash_passwords(["abca", "cc", "cccc"], salt)
+        for engine, run_mode in itertools.product(DES_ENGINES, ["-s", "-m", "-g"]):
+            assert run(f"./brute {run_mode} -a abc -l 4 --des-engine {engine} "
+                       f"-h {hashes[0]}") == "Password found: 'abca'"
+            assert run(f"./brute {run_mode} -a abc -l 2 --des-engine {engine} "
+                       f"-h {hashes[1]}") == "Password found: 'cc'"
+            assert run(f"./brute {run_mode} -a ab -l 4 --des-engine {engine} "
+                       f"-h {hashes[2]}") == "Password not found"
+
+    # Only 8 characters are keyed, the schedule goes back and forth
+    # between words of different lengths
+    words = tmp_path / "words.txt"
+    words.write_text("password\nab\npasswordextra\nzzzzzzzzz\n\u00e9t\u00e9\n")
+    for engine in DES_ENGINES:
+        for password in ["ab", "\u00e9t\u00e9"]:
+            hashed = hash_passwords([password], "hi")[0]
+            assert run(f"./brute -s -w {words} --des-engine {engine} "
+                       f"-h {hashed}") == f"Password found: '{password}'"
+        hashed = hash_passwords(["passwordextra"], "hi")[0]
+        assert run(f"./brute -s -w {words} --des-engine {engine} "
+                   f"-h {hashed}") == "Password found: 'password'"
+
+    # Padding bits that crypt never sets are left to crypt_r to reject
+    itoa64 = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+    hashed = hash_passwords(["ab"], "hi")[0]
+    hashed = hashed[:-1] + itoa64[itoa64.index(hashed[-1]) | 1]
+    assert run(f"./brute -s -a ab -l 2 -h {hashed}") == "Password not found"
+
+
+# Memory-hard hashes
+def test_memory_budget():
+    for salt, per_hash in [("$y$j9T$abcdefgh", 16), ("$7$CU..../....abcdefgh", 64)]:
+        hashed = hash_passwords(["ba"], salt)[0]
+        for run_mode in ["-m", "-g"]:
+            result = sb.run(
+                ["./brute", run_mode, "-a", "ab", "-l", "2", "-t", "4",
+                 "--mem-budget", str(2 * per_hash), "-h", hashed],
+                capture_output=True, text=True,
+            )
+            assert result.stdout.strip() == "Password found: 'ba'"
+            assert f"{per_hash * 1024} KiB per hash, limiting to 2 of 4" in result.stderr
+
+def test_memory_budget_monotonic():
+    # A costlier hash never gets more threads out of the same budget
+    limits = []
+    for salt in ["$y$j9T$abcdefgh", "$7$CU..../....abcdefgh"]:
+        hashed = hash_passwords(["ba"], salt)[0]
+        result = sb.run(["./brute", "-m", "-a", "ab", "-l", "2", "-t", "8",
+                         "--mem-budget", "48", "-h", hashed],
+                        capture_output=True, text=True)
+        assert result.stdout.strip() == "Password found: 'ba'"
+        limits.append(int(result.stderr.split("limiting to ")[1].split()[0]))
+    assert limits == [3, 1]
+
+def test_memory_budget_table(tmp_path):
+    table = tmp_path / "table.bin"
+    hashed = hash_passwords(["ba"], "$y$j9T$abcdefgh")[0]
+    result = sb.run(
+        ["./brute", "--build-table", str(table), "-a", "ab", "-l", "2", "-t", "4",
+         "--mem-budget", "32", "-h", hashed],
+        capture_output=True, text=True,
+    )
+    assert "16384 KiB per hash, limiting to 2 of 4" in result.stderr
+    assert run(f"./brute --table {table} -h {hashed}") == "Password found: 'ba'"
+
+
+# Job queue
+def test_server_jobs(tmp_path):
+    jobs = tmp_path / "jobs.txt"
+    hashes = hash_passwords(["bca", "zyx", "abcd", "qqq"])
+    jobs.write_text(
+        "# hash length alphabet mode priority weight\n"
+        f"{hashes[0]} 3\n"
+        f"{hashes[1]} 3 xyz r 0 2\n"
+        f"{hashes[2]} 4 abcd y 1\n"
+        f"{hashes[3]} 3 abc i\n"
+    )
+    server = sb.Popen(
+        f"./brute -x -p 9403 --jobs {jobs} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.DEVNULL
+    )
+    sleep(0.2)
+    # Clients get every job from the server, none of them is on the command line
+    run("./brute -c -p 9403")
+    result = server.communicate(timeout=30)[0].decode().strip().splitlines()
+    assert sorted(result) == sorted([
+        f"{hashes[0]}: Password found: 'bca'",
+        f"{hashes[1]}: Password found: 'zyx'",
+        f"{hashes[2]}: Password found: 'abcd'",
+        f"{hashes[3]}: Password not found",
+    ])
+
+def test_server_jobs_bcrypt(tmp_path):
+    # One client reuses its job buffer, the batch must notice the new hash
+    jobs = tmp_path / "jobs.txt"
+    hashes = hash_passwords(["bab", "abb"], BCRYPT_SALT)
+    jobs.write_text(f"{hashes[0]} 3 ab\n{hashes[1]} 3 ab\n")
+    server = sb.Popen(
+        f"./brute -x -p 9403 --jobs {jobs} --reserve 1024".split(),
+        stdout=sb.PIPE, stderr=sb.DEVNULL
+    )
+    sleep(0.2)
+    run("./brute -c -p 9403")
+    result = server.communicate(timeout=30)[0].decode().strip().splitlines()
+    assert sorted(result) == sorted([
+        f"{hashes[0]}: Password found: 'bab'",
+        f"{hashes[1]}: Password found: 'abb'",
+    ])
+
+
+
+# Scheduling simulation
+def simulate(tmp_path, spec, args):
+    path = tmp_path / "sim.txt"
+    path.write_text(spec)
+    lines = run(f"./brute --simulate {path} {args}").splitlines()
+    return {line[:12].strip(): line[12:].strip() for line in lines}
+
+def test_simulation(tmp_path):
+    # 8^6 candidates over 4 clients, plus 5 ms for each of the 8^4 tasks
+    report = simulate(tmp_path, "client 4 1000 latency 5\n", "-a abcdefgh -l 6")
+    assert report["makespan"] == "70.656 s"
+    assert report["tasks"] == "4096 dispatched, 0 requeued, 0 candidates lost"
+    # Clients of the same speed never copy each other's tasks
+    assert report["speculation"].startswith("0 copies")
+
+    # Failures and churn are reproducible for a given seed
+    spec = ("seed 3\nchunk fixed 3\n"
+            "client 3 1000 latency 5\n"
+            "client 1 200 latency 50 fail 0.05 rejoin 1\n"
+            "client 1 1000 join 10 leave 40\n")
+    first = simulate(tmp_path, spec, "-a abcdefgh -l 6")
+    assert first == simulate(tmp_path, spec, "-a abcdefgh -l 6")
+    assert " 0 requeued" not in first["tasks"]
+    assert first["job 0"].startswith(first["makespan"])
+
+    # Nobody left to finish the job
+    report = simulate(tmp_path, "client 1 1000 leave 1\n", "-a abcdefgh -l 6")
+    assert "incomplete" in report["makespan"] and report["job 0"].startswith("-")
+
+def test_simulation_speculation(tmp_path):
+    # The fast clients copy the slow one's last task and cancel it
+    spec = "chunk fixed 3\nclient 3 1000 latency 5\nclient 1 10 latency 5\n"
+    copied = simulate(tmp_path, spec, "-a abcdefgh -l 6")
+    waited = simulate(tmp_path, spec + "speculate off\n", "-a abcdefgh -l 6")
+    assert copied["speculation"].startswith("1 copies, 1 finished first")
+    assert not copied["speculation"].startswith("1 copies, 1 finished first, 0 ")
+    assert waited["speculation"].startswith("0 copies")
+    makespan = lambda report: float(report["makespan"].split()[0])
+    assert makespan(copied) < makespan(waited)
+
+def test_simulation_jobs(tmp_path):
+    jobs = tmp_path / "jobs.txt"
+    jobs.write_text("h1 5 abcdefgh i 0\nh2 5 abcdefgh i 1\nh3 5 abcdefgh i 0 3\n")
+    finished = lambda report: sorted(range(3), key=lambda i: float(report[f"job {i}"].split()[0]))
+    # The server's policy: h2 first, then h3 gets three times the share of h1
+    report = simulate(tmp_path, "client 2 1000\n", f"--jobs {jobs}")
+    assert finished(report) == [1, 2, 0]
+    report = simulate(tmp_path, "client 2 1000\ndispatch fifo\n", f"--jobs {jobs}")
+    assert finished(report) == [0, 1, 2]
+
+
+# Batch hashing
+def test_encr_batch(tmp_path):
+    passwords = [f"p{i}" for i in range(5000)] + ["abc", "zz\tab"]
+    expected = [hash_password(p) for p in passwords[:3]] \
+        + [hash_password(p) for p in passwords[-2:-1]] \
+        + [hash_password("zz", "ab")]
+    listing = tmp_path / "passwords.txt"
+    listing.write_text("".join(f"{p}\n" for p in passwords))
+
+    for threads in [1, 3]:
+        lines = run(f"./encr -f {listing} -j {threads}").split()
+        assert len(lines) == len(passwords)
+        assert lines[:3] + lines[-2:] == expected
+
+    tagged = run(f"./encr -f {listing} -t").split()
+    assert tagged[0] == f"{expected[0]}:p0"
+    assert tagged[-1] == f"{expected[-1]}:zz"
+
+
+# Library
+class BruteJob(ctypes.Structure):
+    _fields_ = [
+        ("hash", ctypes.c_char_p),
+        ("alphabet", ctypes.c_char_p),
+        ("length", ctypes.c_int),
+        ("mode", ctypes.c_int),
+    ]
+
+
+class BruteProgress(ctypes.Structure):
+    _fields_ = [
+        ("result", ctypes.c_int),
+        ("tasks_done", ctypes.c_longlong),
+        ("tasks_total", ctypes.c_longlong),
+    ]
+
+
+BRUTE_FOUND, BRUTE_NOT_FOUND, BRUTE_CANCELLED = 1, 2, 3
+BRUTE_CALLBACK = ctypes.CFUNCTYPE(
+    None, ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_char_p
+)
+
+
+def test_library():
+    lib = ctypes.CDLL("./libbrute.so")
+    results = {}
+
+    @BRUTE_CALLBACK
+    def callback(user, job_id, result, password):
+        results[job_id] = (result, password and password.decode())
+
+    session = ctypes.c_void_p()
+    assert lib.brute_session_create(ctypes.byref(session), 2, callback, None) == 0
+
+    def submit(password, alphabet, length, mode=0, salt="hi"):
+        job = BruteJob(hash_password(password, salt).encode(),
+                       alphabet.encode(), length, mode)
+        job_id = ctypes.c_int()
+        assert lib.brute_submit(session, ctypes.byref(job), ctypes.byref(job_id)) == 0
+        return job_id.value
+
+    # The same pool runs every job of the session
+    found = submit("bcab", "abc", 4)
+    recursive = submit("zyx", "xyz", 3, 1)
+    missing = submit("qqq", "abc", 3)
+    bcrypt = submit("bab", "ab", 3, salt=BCRYPT_SALT)
+    # Runs on as many of the threads as fit in memory
+    yescrypt = submit("ba", "ab", 2, salt="$y$j9T$abcdefgh")
+    slow = submit("zzzzzz", "abcdefghijklmnopqrstuvwxyz", 6)
+
+    result = ctypes.c_int()
+    password = ctypes.create_string_buffer(20)
+    for job_id, expected in [(found, "bcab"), (recursive, "zyx"), (bcrypt, "bab"),
+                             (yescrypt, "ba")]:
+        assert lib.brute_wait(session, job_id, ctypes.byref(result), password) == 0
+        assert (result.value, password.value.decode()) == (BRUTE_FOUND, expected)
+    lib.brute_wait(session, missing, ctypes.byref(result), password)
+    assert result.value == BRUTE_NOT_FOUND
+
+    assert lib.brute_cancel(session, slow) == 0
+    lib.brute_wait(session, slow, ctypes.byref(result), None)
+    assert result.value == BRUTE_CANCELLED
+    progress = BruteProgress()
+    assert lib.brute_poll(session, slow, ctypes.byref(progress)) == 0
+    assert progress.tasks_done < progress.tasks_total == 26 ** 4
+
+    bad = BruteJob(b"hi", b"", 3, 0)
+    assert lib.brute_submit(session, ctypes.byref(bad), None) != 0
+    assert lib.brute_poll(session, 100, ctypes.byref(progress)) != 0
+
+    lib.brute_session_destroy(session)
+    assert results == {
+        found: (BRUTE_FOUND, "bcab"),
+        recursive: (BRUTE_FOUND, "zyx"),
+        missing: (BRUTE_NOT_FOUND, None),
+        bcrypt: (BRUTE_FOUND, "bab"),
+        yescrypt: (BRUTE_FOUND, "ba"),
+        slow: (BRUTE_CANCELLED, None),
+    }
+
+
+# Candidate streaming
+def test_stdout():
+    expected = sorted("".join(p) for p in itertools.product("abc", repeat=4))
+    for brute_mode in ["-i", "-r", "-y"]:
+        outputs = [
+            run(f"./brute --stdout {brute_mode} -l 4 -t {threads}").split()
+            for threads in [1, 3]
+        ]
+        # Ordered output, however many threads produce it
+        assert outputs[0] == outputs[1]
+        assert sorted(outputs[0]) == expected
+
+def test_stdout_kernels():
+    # Streamed tasks leave the first length - 1 positions to the leaf, up
+    # to 12: this covers the narrowest and widest enumerator kernels, and
+    # alphabets of 1 to 9 characters hit every remainder of the unrolling
+    alphabets = ["abcdefghi"[:k] for k in range(1, 10)]
+    cases = [(length, alphabet) for length in [1, 2, 3] for alphabet in alphabets]
+    cases += [(length, alphabet) for length in [12, 13] for alphabet in ["a", "ab"]]
+    for length, alphabet in cases:
+        result = run(f"./brute --stdout -i -a {alphabet} -l {length}").split()
+        assert sorted(result) == \
+            ["".join(p) for p in itertools.product(alphabet, repeat=length)]
+
+
+def test_stdout_wordlist_shards(tmp_path):
+    wordlist = tmp_path / "words.txt"
+    wordlist.write_text("hello\nworld\n")
+    rules = tmp_path / "rules.txt"
+    rules.write_text(":\nu\n")
+    result = run(f"./brute --stdout -w {wordlist} -R {rules}").split()
+    assert result == ["hello", "HELLO", "world", "WORLD"]
+
+    shards = [run(f"./brute --stdout -a abcd -l 5 --shard {i}/3").split()
+              for i in range(3)]
+    assert sorted(sum(shards, [])) == \
+        sorted("".join(p) for p in itertools.product("abcd", repeat=5))
@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+bool trace_enabled = false;
+
+static struct trace_buffer_t *buffers = NULL;
+static int next_tid = 0;
+static __thread struct trace_buffer_t *local = NULL;
+
+uint64_t
+trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct trace_buffer_t *
+trace_buffer(void)
+{
+    if (local != NULL)
+        return local;
+
+    local = calloc(1, sizeof(struct trace_buffer_t));
+    if (local == NULL)
+        handle_error("Couldn't allocate space for trace_buffer_t");
+    local->tid = __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
+    local->name = "thread";
+
+    struct trace_buffer_t *head = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+    do
+    {
+        local->next = head;
+    } while (!__atomic_compare_exchange_n(&buffers, &head, local, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return local;
+}
+
+void
+trace_thread(const char *name)
+{
+    if (trace_enabled)
+        trace_buffer()->name = name;
+}
+
+static int
+trace_bucket(uint64_t value)
+{
+    if (value < (1 << TRACE_SUB_BITS))
+        return value;
+    int msb = 63 - __builtin_clzll(value);
+    int sub = (value >> (msb - TRACE_SUB_BITS)) & ((1 << TRACE_SUB_BITS) - 1);
+    return ((msb - TRACE_SUB_BITS + 1) << TRACE_SUB_BITS) + sub;
+}
+
+static uint64_t
+trace_bucket_value(int bucket)
+{
+    if (bucket < (1 << TRACE_SUB_BITS))
+        return bucket;
+    int msb = (bucket >> TRACE_SUB_BITS) + TRACE_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << TRACE_SUB_BITS) - 1);
+    return ((1ULL << TRACE_SUB_BITS) + sub) << (msb - TRACE_SUB_BITS);
+}
+
+void
+trace_end(const char *name, enum trace_hist_t hist, uint64_t start)
+{
+    if (start == 0)
+        return;
+    uint64_t duration = trace_now() - start;
+
+    struct trace_buffer_t *buffer = trace_buffer();
+    if (hist != H_NONE)
+        ++buffer->hist[hist][trace_bucket(duration)];
+    if (buffer->count == TRACE_CAPACITY)
+    {
+        ++buffer->dropped;
+        return;
+    }
+    struct trace_event_t *event = &buffer->events[buffer->count++];
+    event->name = name;
+    event->start = start;
+    event->duration = duration;
+}
+
+static void
+trace_report(const char *name, uint64_t *hist)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < TRACE_BUCKETS; ++i)
+        total += hist[i];
+    if (total == 0)
+        return;
+
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+    fprintf(stderr, "%-12s n=%-10llu", name, (unsigned long long) total);
+    uint64_t seen = 0;
+    int q = 0;
+    for (int i = 0; i < TRACE_BUCKETS && q < 5; ++i)
+    {
+        seen += hist[i];
+        while (q < 5 && seen >= quantiles[q] * total && hist[i] != 0)
+        {
+            fprintf(stderr, " p%g=%.1fus", quantiles[q] * 100,
+                    trace_bucket_value(i) / 1000.0);
+            ++q;
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+// Writes Chrome trace-event JSON and prints latency histograms to stderr
+void
+trace_dump(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+        handle_error("fopen");
+
+    static const char *hist_names[H_COUNT] = { "task", "queue wait" };
+    uint64_t hist[H_COUNT][TRACE_BUCKETS] = { { 0 } };
+    struct trace_buffer_t *list = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+    uint64_t epoch = UINT64_MAX;
+    for (struct trace_buffer_t *buffer = list; buffer != NULL; buffer = buffer->next)
+        for (int i = 0; i < buffer->count; ++i)
+            if (buffer->events[i].start < epoch)
+                epoch = buffer->events[i].start;
+
+    bool first = true;
+    fprintf(out, "{\"traceEvents\":[");
+    for (struct trace_buffer_t *buffer = list; buffer != NULL; buffer = buffer->next)
+    {
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                     "\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",", buffer->tid, buffer->name, buffer->tid);
+        first = false;
+        for (int i = 0; i < buffer->count; ++i)
+        {
+            struct trace_event_t *event = &buffer->events[i];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                         "\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, buffer->tid,
+                    (event->start - epoch) / 1000.0, event->duration / 1000.0);
+        }
+        if (buffer->dropped != 0)
+            fprintf(stderr, "Trace buffer of thread %d dropped %d events\n",
+                    buffer->tid, buffer->dropped);
+        for (int h = 0; h < H_COUNT; ++h)
+            for (int i = 0; i < TRACE_BUCKETS; ++i)
+                hist[h][i] += buffer->hist[h][i];
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    for (int h = 0; h < H_COUNT; ++h)
+        trace_report(hist_names[h], hist[h]);
+}
@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Events recorded per thread, later ones are dropped and counted
+#define TRACE_CAPACITY (1 << 16)
+// Log-linear buckets: 16 per power of two, about 6% relative precision
+#define TRACE_SUB_BITS 4
+#define TRACE_BUCKETS ((64 - TRACE_SUB_BITS + 1) << TRACE_SUB_BITS)
+
+enum trace_hist_t
+{
+    H_NONE = -1,
+    H_TASK,
+    H_QUEUE_WAIT,
+    H_COUNT,
+};
+
+struct trace_event_t
+{
+    const char *name;
+    uint64_t start, duration;
+};
+
+// Owned by one thread, published to the dumper through a lock-free list
+struct trace_buffer_t
+{
+    struct trace_event_t events[TRACE_CAPACITY];
+    uint64_t hist[H_COUNT][TRACE_BUCKETS];
+    int count, dropped, tid;
+    const char *name;
+    struct trace_buffer_t *next;
+};
+
+extern bool trace_enabled;
+
+uint64_t
+trace_now(void);
+
+void
+trace_thread(const char *name);
+
+void
+trace_end(const char *name, enum trace_hist_t hist, uint64_t start);
+
+void
+trace_dump(const char *path);
+
+// Zero when tracing is off, which makes trace_end a no-op
+static inline uint64_t
+trace_begin(void)
+{
+    return trace_enabled ? trace_now() : 0;
+}
+
+#endif // TRACE_H
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include "wordlist.h"
+#include "common.h"
+#include "rules.h"
+#include "iterative.h"
+#include "kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define handle_error(msg) \
+    do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+struct wordlist_t *
+wordlist_open(const char *path)
+{
+    struct wordlist_t *wordlist = malloc(sizeof(struct wordlist_t));
+    if (wordlist == NULL)
+        handle_error("Couldn't allocate space for wordlist_t");
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        handle_error("open");
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        handle_error("fstat");
+
+    wordlist->size = st.st_size;
+    wordlist->data = NULL;
+    if (wordlist->size > 0)
+    {
+        void *data = mmap(NULL, wordlist->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            handle_error("mmap");
+        // Every chunk is read front to back exactly once
+        madvise(data, wordlist->size, MADV_SEQUENTIAL);
+        wordlist->data = data;
+    }
+    close(fd);
+
+    return wordlist;
+}
+
+void
+wordlist_close(struct wordlist_t *wordlist)
+{
+    if (wordlist->data != NULL)
+        munmap((void *) wordlist->data, wordlist->size);
+    free(wordlist);
+}
+
+// Returns the first byte after the line containing pos - 1
+static long long
+wl_align(struct wordlist_t *wordlist, long long pos, long long end)
+{
+    if (pos >= end) return end;
+    const char *nl = memchr(wordlist->data + pos, '\n', end - pos);
+    return (nl == NULL) ? end : nl - wordlist->data + 1;
+}
+
+// Shards get contiguous slices of about the same number of bytes, the
+// boundaries are aligned the same way for the shards on either side
+static long long
+wl_boundary(struct wordlist_t *wordlist, long long end, int shard, int shard_count)
+{
+    long long pos = end * shard / shard_count;
+    return (pos == 0) ? 0 : wl_align(wordlist, pos - 1, end);
+}
+
+void
+wl_shard(struct wordlist_t *wordlist, struct task_t *task, struct config_t *config)
+{
+    long long end = task->end;
+    task->offset = wl_boundary(wordlist, end, config->shard_index, config->shard_count);
+    task->end = wl_boundary(wordlist, end, config->shard_index + 1, config->shard_count);
+}
+
+void
+wl_init(struct wl_state_t *state, struct task_t *task, struct config_t *config)
+{
+    state->wordlist = config->wordlist;
+    state->task = task;
+    state->end = task->end;
+    state->chunk = WL_CHUNK_SIZE;
+    if (config->brute_mode == M_HYBRID || config->brute_mode == M_HYBRID_PREFIX)
+    {
+        size_t alph_size = strlen(config->alphabet);
+        for (int i = 0; i < config->length && state->chunk > 1; ++i)
+            state->chunk /= alph_size;
+        if (state->chunk < 1) state->chunk = 1;
+    }
+    task->end = wl_align(state->wordlist, task->offset + state->chunk, state->end);
+}
+
+bool
+wl_next(struct wl_state_t *state)
+{
+    struct task_t *task = state->task;
+    if (task->end >= state->end) return false;
+    task->offset = task->end;
+    task->end = wl_align(state->wordlist, task->offset + state->chunk, state->end);
+    return true;
+}
+
+static bool
+wl_split(struct task_t *task,
+         struct config_t *config,
+         void *context,
+         password_handler_t handler)
+{
+    struct wl_state_t state;
+    long long offset = task->offset;
+    wl_init(&state, task, config);
+    bool found = false;
+    while (!found)
+    {
+        found = handler(context, task);
+        if (!wl_next(&state))
+            break;
+    }
+    task->offset = offset;
+    task->end = state.end;
+    return found;
+}
+
+static bool
+wl_words(struct task_t *task,
+         struct config_t *config,
+         void *context,
+         password_handler_t handler)
+{
+    const char *data = config->wordlist->data;
+    const char *cur = data + task->offset;
+    const char *end = data + task->end;
+
+    long page = sysconf(_SC_PAGESIZE);
+    long long aligned = task->offset & ~(long long) (page - 1);
+    madvise((void *) (data + aligned), task->end - aligned, MADV_WILLNEED);
+
+    while (cur < end)
+    {
+        const char *nl = memchr(cur, '\n', end - cur);
+        if (nl == NULL) nl = end;
+
+        size_t length = nl - cur;
+        if (length > 0 && cur[length - 1] == '\r') --length;
+        if (length < PASSWORD_SIZE)
+        {
+            bool found;
+            if (config->rules != NULL)
+            {
+                found = rules_apply(config->rules, cur, length,
+                                    task, context, handler);
+            }
+            else
+            {
+                memcpy(task->password, cur, length);
+                task->password[length] = '\0';
+                found = handler(context, task);
+            }
+            if (found) return true;
+        }
+        cur = nl + 1;
+    }
+    return false;
+}
+
+// The word is written once, then only the tail positions are enumerated
+// by the same code as the iterative mode
+static bool
+wl_hybrid(struct task_t *task,
+          struct config_t *config,
+          void *context,
+          password_handler_t handler)
+{
+    const char *data = config->wordlist->data;
+    const char *cur = data + task->offset;
+    const char *end = data + task->end;
+    int tail = config->length;
+    bool prefix = (config->brute_mode == M_HYBRID_PREFIX);
+    int to = task->to;
+
+    bool found = false;
+    while (cur < end && !found)
+    {
+        const char *nl = memchr(cur, '\n', end - cur);
+        if (nl == NULL) nl = end;
+
+        size_t length = nl - cur;
+        if (length > 0 && cur[length - 1] == '\r') --length;
+        if (length + tail < PASSWORD_SIZE)
+        {
+            memcpy(task->password + (prefix ? tail : 0), cur, length);
+            task->password[length + tail] = '\0';
+            task->from = prefix ? 0 : length;
+            task->to = task->from + tail;
+            enumerator_kernel_t kernel = kernel_select(task, config);
+            if (kernel != NULL)
+                found = kernel(task, config, context, handler);
+            else
+                found = bruteforce_iter(task, config, context, handler);
+        }
+        cur = nl + 1;
+    }
+
+    task->from = 0;
+    task->to = to;
+    return found;
+}
+
+bool
+bruteforce_wordlist(struct task_t *task,
+                    struct config_t *config,
+                    void *context,
+                    password_handler_t handler)
+{
+    // Run modes split the keyspace with nonzero task->from and hand
+    // out tasks with task->from == 0 to the workers
+    if (task->from != 0)
+        return wl_split(task, config, context, handler);
+    if (config->brute_mode != M_WORDLIST)
+        return wl_hybrid(task, config, context, handler);
+    return wl_words(task, config, context, handler);
+}
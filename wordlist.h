@@ -0,0 +1,48 @@
+#ifndef WORDLIST_H
+#define WORDLIST_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Tasks handed to workers cover about this many bytes of the wordlist
+#define WL_CHUNK_SIZE (1 << 20)
+
+struct wordlist_t
+{
+    const char *data;
+    long long size;
+};
+
+struct wl_state_t
+{
+    struct wordlist_t *wordlist;
+    struct task_t *task;
+    long long end;
+    // Bytes of words per task, less in hybrid modes where each word
+    // stands for a whole tail keyspace
+    long long chunk;
+};
+
+struct wordlist_t *
+wordlist_open(const char *path);
+
+void
+wordlist_close(struct wordlist_t *);
+
+// Restricts the task covering the whole wordlist to this shard's slice
+void
+wl_shard(struct wordlist_t *, struct task_t *, struct config_t *);
+
+void
+wl_init(struct wl_state_t *, struct task_t *, struct config_t *);
+
+bool
+wl_next(struct wl_state_t *);
+
+bool
+bruteforce_wordlist(struct task_t *, struct config_t *, void *context,
+                    password_handler_t);
+
+#endif // WORDLIST_H